@@ -36,11 +36,14 @@ hal::status application(hal::esp8266::hardware_map& p_map)
 
   // 8kB buffer to read data into
   std::array<hal::byte, 8192> buffer{};
+  // Holds payload that arrives while the driver waits on a command
+  std::array<hal::byte, hal::esp8266::at::maximum_packet_size> receive_buffer{};
 
   // Connect to WiFi AP
   hal::print(console, "Create esp8266 object...\n");
   auto timeout = hal::create_timeout(counter, 20s);
-  auto esp8266 = HAL_CHECK(hal::esp8266::at::create(serial, timeout));
+  auto esp8266 =
+    HAL_CHECK(hal::esp8266::at::create(serial, receive_buffer, timeout));
   hal::print(console, "Esp8266 created! \n");
 
   hal::print(console, "Connecting to AP...\n");
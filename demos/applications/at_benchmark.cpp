@@ -17,6 +17,7 @@
 #include <string_view>
 
 #include <libhal-esp8266/at.hpp>
+#include <libhal-esp8266/supervisor.hpp>
 #include <libhal-util/serial.hpp>
 #include <libhal-util/steady_clock.hpp>
 #include <libhal-util/streams.hpp>
@@ -27,85 +28,25 @@
 #include "helper.hpp"
 
 namespace {
-enum class connection_state
-{
-  check_ap_connection,
-  connecting_to_ap,
-  set_ip_address,
-  check_server_connection,
-  connecting_to_server,
-  connection_established,
-};
-
 [[nodiscard]] hal::status establish_connection(
-  hal::esp8266::at& p_esp8266,
+  hal::esp8266::supervisor& p_supervisor,
   hal::serial& p_console,
-  const std::string_view p_ssid,
-  const std::string_view p_password,
-  const hal::esp8266::at::socket_config& p_config,
-  const std::string_view p_ip,
-  hal::timeout auto& p_timeout)
+  hal::steady_clock& p_counter,
+  hal::time_duration p_limit)
 {
-  connection_state state = connection_state::check_ap_connection;
-
-  while (state != connection_state::connection_established) {
-    switch (state) {
-      case connection_state::check_ap_connection:
-        hal::print(p_console, "Checking if AP \"");
-        hal::print(p_console, p_ssid);
-        hal::print(p_console, "\" is connected... ");
-        if (HAL_CHECK(p_esp8266.is_connected_to_ap(p_timeout))) {
-          state = connection_state::check_server_connection;
-          hal::print(p_console, "Connected!\n");
-        } else {
-          state = connection_state::connecting_to_ap;
-          hal::print(p_console, "NOT Connected!\n");
-        }
-        break;
-      case connection_state::connecting_to_ap:
-        hal::print(p_console, "Connecting to AP: \"");
-        hal::print(p_console, p_ssid);
-        hal::print(p_console, "\" ...\n");
-        HAL_CHECK(p_esp8266.connect_to_ap(p_ssid, p_password, p_timeout));
-        state = connection_state::set_ip_address;
-        break;
-      case connection_state::set_ip_address:
-        if (!p_ip.empty()) {
-          hal::print(p_console, "Setting IP Address to: ");
-          hal::print(p_console, p_ip);
-          hal::print(p_console, " ...\n");
-          HAL_CHECK(p_esp8266.set_ip_address(p_ip, p_timeout));
-        }
-        state = connection_state::check_server_connection;
-        break;
-      case connection_state::check_server_connection:
-        hal::print(p_console, "Checking if server \"");
-        hal::print(p_console, p_config.domain);
-        hal::print(p_console, "\" is connected... ");
-        if (HAL_CHECK(p_esp8266.is_connected_to_server(p_timeout))) {
-          state = connection_state::connection_established;
-          hal::print(p_console, "Connected!\n");
-        } else {
-          state = connection_state::connecting_to_server;
-          hal::print(p_console, "NOT Connected!\n");
-        }
-        break;
-      case connection_state::connecting_to_server:
-        hal::print(p_console, "Connecting to server: \"");
-        hal::print(p_console, p_config.domain);
-        hal::print(p_console, "\" ...\n");
-        HAL_CHECK(p_esp8266.connect_to_server(p_config, p_timeout));
-        state = connection_state::check_server_connection;
-        break;
-      case connection_state::connection_established:
-        // Do nothing, allow next iteration to break while loop
-        break;
-      default:
-        state = connection_state::connecting_to_ap;
+  using namespace std::chrono_literals;
+
+  hal::print(p_console, "Establishing connection to AP & server...\n");
+  auto limit = hal::create_timeout(p_counter, p_limit);
+
+  while (true) {
+    auto timeout = hal::create_timeout(p_counter, 10s);
+    if (p_supervisor.poll(timeout) == hal::work_state::finished) {
+      hal::print(p_console, "Connected!\n");
+      return hal::success();
     }
+    HAL_CHECK(limit());
   }
-
-  return hal::success();
 }
 
 struct http_header_parser_t
@@ -148,23 +89,43 @@ hal::status application(hal::esp8266::hardware_map& p_map)
     .port = 80,
   };
 
-  // Leave empty to not use
-  constexpr std::string_view ip = "";
+  // Leave the IP address empty to use DHCP
+  constexpr auto network = hal::esp8266::at::network_config{
+    .ip = "",
+    .gateway = "",
+    .netmask = "",
+  };
 
   // 128B buffer to read data into
   std::array<hal::byte, 128> buffer{};
+  // Holds payload that arrives while the driver waits on a command
+  std::array<hal::byte, hal::esp8266::at::maximum_packet_size> receive_buffer{};
 
   hal::print(console, "ESP8266 WiFi Client Application Starting...\n");
 
   // Initialize esp8266 & create driver object
   hal::print(console, "Create & initialize esp8266...\n");
   auto timeout = hal::create_timeout(counter, 10s);
-  auto esp8266 = HAL_CHECK(hal::esp8266::at::create(serial, timeout));
+  auto esp8266 =
+    HAL_CHECK(hal::esp8266::at::create(serial, receive_buffer, timeout));
   hal::print(console, "esp8266 created & initialized!! \n");
 
+  // The supervisor keeps track of the connection from the module's
+  // notifications, so reconnecting only repeats the steps that are needed.
+  auto supervisor = HAL_CHECK(hal::esp8266::supervisor::create(
+    esp8266,
+    counter,
+    { .ssid = ssid,
+      .password = password,
+      .network = network,
+      .server = socket_config }));
+  esp8266.on_event([&supervisor](auto p_event, auto p_link) {
+    supervisor.handle_event(p_event, p_link);
+  });
+
   // Establish connection with AP & web server
-  auto establish_result = establish_connection(
-    esp8266, console, ssid, password, socket_config, ip, timeout);
+  auto establish_result =
+    establish_connection(supervisor, console, counter, 30s);
 
   if (!establish_result) {
     hal::print(console,
@@ -203,12 +164,9 @@ hal::status application(hal::esp8266::hardware_map& p_map)
 
     if (write_error) {
       hal::print(console, "Reconnecting...\n");
-      // Wait 1s before attempting to reconnect
-      hal::delay(counter, 1s);
-
-      timeout = hal::create_timeout(counter, 20s);
-      auto result = establish_connection(
-        esp8266, console, ssid, password, socket_config, ip, timeout);
+      // The supervisor spaces out the attempts
+      supervisor.connection_lost();
+      auto result = establish_connection(supervisor, console, counter, 20s);
       if (!result) {
         continue;
       }
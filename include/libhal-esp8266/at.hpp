@@ -15,12 +15,16 @@
 #pragma once
 
 #include <array>
+#include <cstddef>
 #include <cstdint>
+#include <span>
 #include <string_view>
 
 #include <libhal/functional.hpp>
 #include <libhal/serial.hpp>
+#include <libhal/steady_clock.hpp>
 #include <libhal/timeout.hpp>
+#include <libhal/units.hpp>
 
 /**
  * @brief libhal compatible libraries for the esp8266 device and microcontroller
@@ -39,10 +43,95 @@ class at
 public:
   using deadline = hal::function_ref<hal::timeout_function>;
 
+  /// Number of links available in multiple connection mode
+  static constexpr std::uint8_t maximum_links = 5;
+  /// Largest payload the module delivers in one +IPD packet
+  static constexpr std::size_t maximum_packet_size = 1460;
+  /// Number of domains the DNS cache remembers
+  static constexpr std::size_t dns_cache_size = 4;
+
+  enum class connection_mode : std::uint8_t
+  {
+    /// One connection, addressed as link 0 (AT+CIPMUX=0)
+    single,
+    /// Up to `maximum_links` simultaneous connections (AT+CIPMUX=1)
+    multiple,
+  };
+
+  /// Hardware flow control used by the module's UART, values match the
+  /// flow control field of AT+UART_CUR
+  enum class flow_control : std::uint8_t
+  {
+    /// No flow control
+    none = 0,
+    /// The module raises RTS when its receive buffer is nearly full
+    rts = 1,
+    /// The module stops sending while the host holds CTS high
+    cts = 2,
+    /// Both directions are flow controlled
+    rts_cts = 3,
+  };
+
+  /// Outcome of each command given to `run_commands()`
+  enum class command_status : std::uint8_t
+  {
+    /// Sent and waiting for a response
+    pending,
+    /// The module responded with OK
+    ok,
+    /// The module responded with ERROR or FAIL
+    error,
+    /// The module was busy and dropped the command, it will be sent again
+    busy,
+  };
+
+  /// Unsolicited notifications the module sends on its own
+  enum class event : std::uint8_t
+  {
+    /// A connection was opened, "[<link>,]CONNECT"
+    link_connected,
+    /// A connection was closed by either end, "[<link>,]CLOSED"
+    link_closed,
+    /// Joined an access point, "WIFI CONNECTED"
+    ap_connected,
+    /// Got an IP address from the access point, "WIFI GOT IP"
+    got_ip,
+    /// Lost the access point, "WIFI DISCONNECT"
+    ap_disconnected,
+  };
+
+  /// Signature of the handler given to `on_event()`, the link is 0 for
+  /// events that do not belong to a connection
+  using event_handler = void(event p_event, std::uint8_t p_link);
+
+  enum class receive_mode : std::uint8_t
+  {
+    /// The module forwards payload as soon as it arrives (AT+CIPRECVMODE=0)
+    active,
+    /// The module holds TCP payload until it is pulled with AT+CIPRECVDATA
+    /// (AT+CIPRECVMODE=1)
+    passive,
+  };
+
   enum class socket_type : std::uint8_t
   {
     tcp,
     udp,
+    /// TLS over TCP, run by the module, see `set_ssl_auth()`
+    ssl,
+  };
+
+  /// Certificates checked during the TLS handshake (AT+CIPSSLCCONF)
+  enum class ssl_auth : std::uint8_t
+  {
+    /// No certificates are checked
+    none = 0,
+    /// The module presents the client_cert and client_key partitions
+    client_certificate = 1,
+    /// The server's certificate is checked against the client_ca partition
+    server_certificate = 2,
+    /// Both of the above
+    mutual = 3,
   };
 
   struct socket_config
@@ -50,6 +139,52 @@ public:
     socket_type type = socket_type::tcp;
     std::string_view domain;
     std::uint16_t port = 80;
+    /// UDP only, the port to receive on. When set, datagrams from any sender
+    /// are accepted (UDP mode 2), so `send_to()` can reply to them.
+    std::uint16_t local_port = 0;
+    /// TCP and SSL only, seconds of silence before the module sends a TCP
+    /// keep alive, from 1 to 7200. Zero leaves keep alive off.
+    std::uint16_t keep_alive = 0;
+  };
+
+  /// Static network settings for station mode, addresses are dotted IPv4
+  struct network_config
+  {
+    std::string_view ip;
+    /// Leave both the gateway and netmask empty to keep the module's own
+    std::string_view gateway = "";
+    std::string_view netmask = "";
+    /// Leave empty to keep the module's DNS servers
+    std::string_view primary_dns = "";
+    std::string_view secondary_dns = "";
+  };
+
+  /// Access point found by `scan_each()` or `scan()`
+  struct scan_result
+  {
+    std::array<char, 32> ssid{};
+    std::uint8_t ssid_length = 0;
+    std::array<char, 17> bssid{};
+    std::uint8_t channel = 0;
+    /// Signal strength in dBm
+    std::int8_t rssi = 0;
+
+    std::string_view name() const
+    {
+      return std::string_view(ssid.data(), ssid_length);
+    }
+  };
+
+  using scan_handler = void(const scan_result& p_result);
+
+  /// Access point the module is joined to, from AT+CWJAP?
+  struct access_point
+  {
+    /// MAC address of the access point, "aa:bb:cc:dd:ee:ff"
+    std::array<char, 17> bssid{};
+    std::uint8_t channel = 0;
+    /// Signal strength in dBm
+    std::int8_t rssi = 0;
   };
 
   struct read_t
@@ -64,61 +199,1069 @@ public:
     std::span<const hal::byte> data;
   };
 
+  /// A UDP datagram and who sent it, see `receive_from()`
+  struct datagram
+  {
+    /// Payload, cut short if the buffer was smaller than the datagram. Empty
+    /// if no datagram has arrived.
+    std::span<hal::byte> data;
+    /// Sender's dotted IPv4 address, only sent by the module with
+    /// AT+CIPDINFO=1, see `set_remote_info()`
+    std::array<char, 15> address{};
+    std::uint8_t address_length = 0;
+    std::uint16_t port = 0;
+
+    std::string_view remote_address() const
+    {
+      return std::string_view(address.data(), address_length);
+    }
+  };
+
+  /**
+   * @brief Handle to an operation started by one of the `start_*()` methods
+   *
+   * The command is written when the operation starts, after that `poll()`
+   * only looks at the bytes that have already arrived and never waits on the
+   * module, so it can be called from a superloop alongside other work. The
+   * handle also satisfies the worker interface used by `hal::try_until()`.
+   *
+   * The driver runs one operation at a time. Only the handle of the most
+   * recent operation is meaningful and the driver must not be moved while it
+   * is in use. Strings and buffers passed to `start_*()` must stay valid
+   * until the operation has terminated.
+   */
+  class operation
+  {
+  public:
+    /**
+     * @brief Advance the operation with whatever bytes have arrived
+     *
+     * @return hal::result<hal::work_state> - `finished` once the module has
+     * completed the command, `in_progress` if it still has to respond, or
+     * an error if the command failed.
+     */
+    [[nodiscard]] hal::result<hal::work_state> poll();
+    [[nodiscard]] hal::result<hal::work_state> operator()();
+    [[nodiscard]] hal::work_state state() const;
+    /**
+     * @brief Give up on the operation so another one can be started
+     *
+     * The module may still answer the abandoned command, so this should
+     * only be used before resetting the module or after a generous timeout.
+     */
+    void cancel();
+    /**
+     * @return bool - for `is_connected` queries, the answer once the
+     * operation has finished
+     */
+    [[nodiscard]] bool result() const;
+
+  private:
+    friend class at;
+    operation(at& p_driver);
+
+    at* m_driver;
+  };
+
+  /**
+   * @brief A single connection of the driver
+   *
+   * In single connection mode only link 0 exists and it is the same
+   * connection used by `connect_to_server()`, `server_write()`, etc. Links
+   * refer back to the driver they came from, so the driver must not be moved
+   * while they are in use.
+   */
+  class link
+  {
+  public:
+    [[nodiscard]] hal::status connect(socket_config p_config,
+                                      deadline p_timeout);
+    [[nodiscard]] hal::result<bool> is_connected(deadline p_timeout);
+    [[nodiscard]] hal::result<write_t> write(std::span<const hal::byte> p_data,
+                                             deadline p_timeout);
+    [[nodiscard]] hal::result<read_t> read(std::span<hal::byte> p_data);
+    [[nodiscard]] hal::result<read_t> read(std::span<hal::byte> p_data,
+                                           deadline p_timeout);
+    [[nodiscard]] hal::result<std::span<const hal::byte>> acquire_read();
+    void release_read(std::size_t p_length);
+    [[nodiscard]] hal::result<write_t> send_to(
+      std::span<const hal::byte> p_data,
+      std::string_view p_address,
+      std::uint16_t p_port,
+      deadline p_timeout);
+    [[nodiscard]] hal::result<datagram> receive_from(
+      std::span<hal::byte> p_buffer,
+      deadline p_timeout);
+    [[nodiscard]] hal::status set_ssl_auth(ssl_auth p_auth,
+                                           deadline p_timeout);
+    [[nodiscard]] hal::status disconnect(deadline p_timeout);
+    [[nodiscard]] hal::result<operation> start_connect(socket_config p_config);
+    [[nodiscard]] hal::result<operation> start_is_connected();
+    [[nodiscard]] hal::result<operation> start_write(
+      std::span<const hal::byte> p_data);
+    [[nodiscard]] hal::result<operation> start_disconnect();
+    std::uint8_t id() const;
+
+  private:
+    friend class at;
+    link(at& p_driver, std::uint8_t p_id);
+
+    at* m_driver;
+    std::uint8_t m_id;
+  };
+
+  /**
+   * @brief Raw byte stream to the server while in transparent mode
+   *
+   * Writes go straight to the module's UART and are forwarded to the server
+   * without any AT+CIPSEND framing, and reads return the server's data with
+   * no +IPD headers. The stream refers back to the driver it came from, so
+   * the driver must not be moved while it is in use. No other driver APIs
+   * may be used until `stop_transparent_mode()` is called.
+   */
+  class transparent_stream : public hal::serial
+  {
+  private:
+    friend class at;
+    transparent_stream(at& p_driver);
+
+    hal::status driver_configure(const settings& p_settings) override;
+    hal::result<write_t> driver_write(
+      std::span<const hal::byte> p_data) override;
+    hal::result<read_t> driver_read(std::span<hal::byte> p_data) override;
+    hal::result<flush_t> driver_flush() override;
+
+    at* m_driver;
+  };
+
+  /**
+   * @brief Reset the module and create a driver for it
+   *
+   * Payload that arrives while the driver is waiting on a command, or for a
+   * link other than the one being read, is kept in `p_receive_buffer` until
+   * it is read. In single connection mode link 0 has all of it, in multiple
+   * connection mode it is shared as set by `set_link_buffer_sizes()`, evenly
+   * by default. A packet that doesn't fit is left in the serial port until
+   * its link is read, so give each link at least `maximum_packet_size` bytes
+   * to hold a whole packet, such as `maximum_links * maximum_packet_size`
+   * when using multiple connections. Only the first 65535 bytes are used.
+   *
+   * @param p_serial - serial port connected to the module
+   * @param p_receive_buffer - storage for received payload, must outlive the
+   * driver
+   * @param p_timeout - deadline for the module to reset
+   * @return result<at> - the driver
+   */
   [[nodiscard]] static result<at> create(hal::serial& p_serial,
+                                         std::span<hal::byte> p_receive_buffer,
                                          deadline p_timeout);
+  /**
+   * @brief Create a driver for a module that may already be running
+   *
+   * Meant for when the host restarts but the module stays powered. If the
+   * module answers a probe, echo is turned off and the driver adopts the
+   * connection and receive modes left by the previous session, along with
+   * which open links are UDP. The module is not reset, so an existing access
+   * point association and any open connections are kept. A server started
+   * by the previous session keeps running on the module, but the driver
+   * doesn't know about it, so call `stop_server()` and `start_server()`
+   * before using `accept()`. If the probe goes unanswered, this falls back
+   * to the full reset done by `create()`.
+   *
+   * The module must still be at the default baud rate of 115200.
+   *
+   * @param p_serial - serial port connected to the module
+   * @param p_receive_buffer - storage for received payload, see `create()`
+   * @param p_probe_timeout - deadline for the module to answer the probe and
+   * the mode queries, a few hundred milliseconds is plenty
+   * @param p_timeout - deadline for the reset if one is needed
+   * @return result<at> - the driver
+   */
+  [[nodiscard]] static result<at> warm_start(
+    hal::serial& p_serial,
+    std::span<hal::byte> p_receive_buffer,
+    deadline p_probe_timeout,
+    deadline p_timeout);
   template<unsigned id>
   [[nodiscard]] static result<at&> initialize(hal::serial& p_serial,
                                               deadline p_timeout);
 
   // System Control Commands
   [[nodiscard]] hal::status reset(deadline p_timeout);
+  /**
+   * @brief Send independent commands back to back without waiting in between
+   *
+   * Every command is written before any response is read, so a sequence of
+   * N commands costs one round trip rather than N. Responses are matched to
+   * commands in order. Commands the module drops with "busy p..." because an
+   * earlier one was still running are sent again once the rest have been
+   * answered, so the commands must not depend on each other's order. Only
+   * commands that finish with OK or ERROR may be used, AT+RST and AT+CIPSEND
+   * need their own methods.
+   *
+   * @param p_commands - commands without the trailing "\r\n", such as
+   * "AT+CWMODE=1", each at most 256 characters long
+   * @param p_status - receives the outcome of each command, must be at least
+   * as long as `p_commands`
+   * @param p_timeout - deadline for all commands to be answered
+   * @return hal::status - success if every command responded OK.
+   * `std::errc::io_error` if any responded with ERROR, see `p_status` for
+   * which. `std::errc::invalid_argument` if a command is too long, in which
+   * case nothing is sent.
+   */
+  [[nodiscard]] hal::status run_commands(
+    std::span<const std::string_view> p_commands,
+    std::span<command_status> p_status,
+    deadline p_timeout);
+  /**
+   * @brief Move the module and the host serial port to a new baud rate
+   *
+   * Sends AT+UART_CUR with the new rate, reconfigures the serial port passed
+   * to `create()` to match, keeping the rest of the settings given to
+   * `set_serial_settings()`, then confirms the link with an AT probe. If the
+   * probe fails, the module is asked to return to the previous rate and the
+   * link is verified again at that rate, so the driver stays usable even
+   * when the host cannot keep up with the requested rate. The change is not
+   * saved to the module's flash; `reset()` returns both sides to 115200.
+   *
+   * @param p_baud_rate - new baud rate such as 460800, 921600 or 2000000
+   * @param p_timeout - deadline for the module to accept the rate and answer
+   * the probe
+   * @param p_fallback_timeout - deadline for restoring the previous rate if
+   * the new one does not work
+   * @return hal::status - success if the new rate is in use. On failure the
+   * error from the new rate is returned and `baud_rate()` reports the rate
+   * the driver fell back to.
+   */
+  [[nodiscard]] hal::status set_baud_rate(std::uint32_t p_baud_rate,
+                                          deadline p_timeout,
+                                          deadline p_fallback_timeout);
+  /**
+   * @return std::uint32_t - the last baud rate confirmed to work
+   */
+  [[nodiscard]] std::uint32_t baud_rate() const;
+  /**
+   * @brief Enable hardware flow control on the module's UART
+   *
+   * Resends AT+UART_CUR at the current baud rate with the new flow control
+   * setting, which is also kept for later `set_baud_rate()` calls. The host
+   * side RTS/CTS lines are not part of `hal::serial` and must be set up by
+   * the platform before enabling flow control here. Like the baud rate, the
+   * setting is lost on `reset()`.
+   *
+   * @param p_flow_control - flow control lines the module should use
+   * @param p_timeout - deadline for the module to respond
+   * @return hal::status - success or failure
+   */
+  [[nodiscard]] hal::status set_flow_control(flow_control p_flow_control,
+                                             deadline p_timeout);
+  /**
+   * @brief Tell the driver how the host serial port is configured
+   *
+   * `hal::serial` can't report its settings, so the driver keeps its own
+   * copy and only changes the baud rate in it when it moves the port to a
+   * new rate in `set_baud_rate()` or `reset()`. The copy starts out as the
+   * default `hal::serial::settings`. Call this if the port uses other stop
+   * bits or parity.
+   *
+   * @param p_settings - settings the serial port passed to `create()` is
+   * configured with
+   */
+  void set_serial_settings(const hal::serial::settings& p_settings);
+  /**
+   * @brief Trust the UART link to deliver every byte intact
+   *
+   * By default a malformed +IPD header is assumed to be the result of lost
+   * or corrupted bytes, so the driver quietly drops it and hunts for the next
+   * header. Once flow control guarantees that nothing is dropped, a
+   * malformed header can only mean the driver and module disagree, so in
+   * lossless mode it is reported as `std::errc::io_error` instead of being
+   * skipped along with the payload behind it.
+   *
+   * @param p_lossless - true if the link never drops or corrupts bytes
+   */
+  void set_lossless(bool p_lossless);
+  /**
+   * @brief Set the handler for unsolicited notifications from the module
+   *
+   * Notifications are recognized wherever they appear in the response
+   * stream, including in the middle of another command's response, and the
+   * handler is called from within whichever driver call found them. +IPD
+   * payload found the same way is kept in the receive buffer. The handler
+   * must not call back into the driver.
+   *
+   * @param p_handler - handler to call, replaces any previous handler
+   */
+  void on_event(hal::callback<event_handler> p_handler);
+  /**
+   * @brief Dispatch notifications that arrived while the driver was idle
+   *
+   * Payload found along the way is kept in the receive buffer.
+   *
+   * @return hal::status - success, or `std::errc::device_or_resource_busy`
+   * while an operation from `start_*()` has not terminated
+   */
+  [[nodiscard]] hal::status poll_events();
 
   // WiFi access point commands
   [[nodiscard]] hal::status connect_to_ap(std::string_view p_ssid,
                                           std::string_view p_password,
                                           deadline p_timeout);
+  /**
+   * @brief Join a specific access point without scanning for it
+   *
+   * With the BSSID given, the module joins that access point directly rather
+   * than scanning every channel for the strongest one with the SSID. Take
+   * the BSSID from `connected_access_point()` after a successful join and
+   * pass it back in to rejoin quickly. The join fails if that access point
+   * is gone, so fall back to joining by SSID alone.
+   *
+   * @param p_ssid - network name
+   * @param p_password - network password
+   * @param p_bssid - MAC address of the access point, "aa:bb:cc:dd:ee:ff", or
+   * empty to scan as usual
+   * @param p_timeout - deadline for the module to join
+   * @return hal::status - success or failure
+   */
+  [[nodiscard]] hal::status connect_to_ap(std::string_view p_ssid,
+                                          std::string_view p_password,
+                                          std::string_view p_bssid,
+                                          deadline p_timeout);
+  /**
+   * @brief Get the details of the access point the module is joined to
+   *
+   * The channel is reported for information only, AT+CWJAP has no way to
+   * pass it back in.
+   *
+   * @param p_timeout - deadline for the module to respond
+   * @return hal::result<access_point> - the access point, or
+   * `std::errc::not_connected` if the module has not joined one
+   */
+  [[nodiscard]] hal::result<access_point> connected_access_point(
+    deadline p_timeout);
   [[nodiscard]] hal::status set_ip_address(std::string_view p_ip,
                                            deadline p_timeout);
+  /**
+   * @brief List the access points in range with AT+CWLAP
+   *
+   * AT+CWLAPOPT first limits each entry to the SSID, signal strength, BSSID
+   * and channel, sorted strongest first. Entries are parsed as they arrive
+   * and passed to `p_handler` one at a time, so the scan needs no buffer for
+   * the whole listing.
+   *
+   * @param p_handler - called with each access point, strongest first
+   * @param p_timeout - deadline for the scan to complete, which takes a few
+   * seconds
+   * @return hal::status - success, `std::errc::io_error` if the module
+   * rejected the scan or sent a malformed entry
+   */
+  [[nodiscard]] hal::status scan_each(
+    hal::function_ref<scan_handler> p_handler,
+    deadline p_timeout);
+  /**
+   * @brief List the strongest access points in range
+   *
+   * @param p_results - where to store the access points, strongest first.
+   * Access points past its end are dropped.
+   * @param p_timeout - deadline for the scan to complete
+   * @return hal::result<std::span<scan_result>> - the part of `p_results`
+   * that was filled
+   */
+  [[nodiscard]] hal::result<std::span<scan_result>> scan(
+    std::span<scan_result> p_results,
+    deadline p_timeout);
+  /**
+   * @brief Give the station a static address and turn off its DHCP client
+   *
+   * Applied before joining an access point, the module has its address as
+   * soon as it associates and never waits on a DHCP server. The DHCP
+   * client is turned off with AT+CWDHCP_CUR, the address is set with
+   * AT+CIPSTA_CUR and the DNS servers with AT+CIPDNS_CUR, all sent back to
+   * back with `run_commands()`. Like other `_CUR` settings they last until
+   * the module is reset.
+   *
+   * @param p_config - addresses to use
+   * @param p_timeout - deadline for the module to apply them
+   * @return hal::status - success, `std::errc::invalid_argument` if the IP
+   * address is missing, only one of the gateway and netmask is given, or a
+   * secondary DNS server is given without a primary.
+   */
+  [[nodiscard]] hal::status set_network_config(const network_config& p_config,
+                                               deadline p_timeout);
+  /**
+   * @brief Turn the station's DHCP client on or off with AT+CWDHCP_CUR
+   *
+   * @param p_enabled - true to get an address from the access point
+   * @param p_timeout - deadline for the module to respond
+   * @return hal::status - success or failure
+   */
+  [[nodiscard]] hal::status set_dhcp(bool p_enabled, deadline p_timeout);
   [[nodiscard]] hal::result<bool> is_connected_to_ap(deadline p_timeout);
   [[nodiscard]] hal::status disconnect_from_ap(deadline p_timeout);
 
   // TCP/UDP AT commands
+  /**
+   * @brief Remember the addresses domains resolve to for reconnects
+   *
+   * Once enabled, `connect_to_server()` and `link::connect()` resolve the
+   * domain with `resolve()` and connect to the address instead, so a
+   * reconnect within the time to live skips the module's DNS lookup. The
+   * non-blocking `start_*connect()` variants use an address that is already
+   * cached but never resolve one themselves. A failed connection forgets the
+   * address in case the server has moved. SSL connections always use the
+   * domain, as the server's certificate is checked against it.
+   *
+   * @param p_clock - clock to age the cached addresses with
+   * @param p_ttl - how long an address is used before it is looked up again
+   */
+  void enable_dns_cache(hal::steady_clock& p_clock, hal::time_duration p_ttl);
+  /**
+   * @brief Time how long each connection takes to open
+   *
+   * The time runs from AT+CIPSTART being sent until the module answers OK,
+   * which for SSL connections includes the TLS handshake.
+   *
+   * @param p_clock - clock to measure with
+   */
+  void measure_connect_time(hal::steady_clock& p_clock);
+  /**
+   * @return hal::time_duration - time the last successful connection took to
+   * open, zero if none has been measured
+   */
+  [[nodiscard]] hal::time_duration last_connect_time() const;
+  /**
+   * @brief Choose the certificates used by SSL connections
+   *
+   * Applies to the SSL connection opened afterwards. In multiple connection
+   * mode this configures link 0, use `link::set_ssl_auth()` for the others.
+   * Certificates come from the first entry of the module's client_ca,
+   * client_cert and client_key partitions. Only supported by the 2.x
+   * firmware.
+   *
+   * @param p_auth - certificates to check
+   * @param p_timeout - deadline for the module to respond
+   * @return hal::status - success or failure
+   */
+  [[nodiscard]] hal::status set_ssl_auth(ssl_auth p_auth, deadline p_timeout);
+  /**
+   * @brief Size the module's TLS buffer with AT+CIPSSLSIZE
+   *
+   * A larger buffer fits larger server records and certificate chains at the
+   * cost of the module's heap. Must be set before opening SSL connections.
+   * Only supported by the 1.7.x firmware, the 2.x firmware sizes the buffer
+   * itself and answers ERROR.
+   *
+   * @param p_size - buffer size in bytes, from 2048 to 4096
+   * @param p_timeout - deadline for the module to respond
+   * @return hal::status - success, `std::errc::invalid_argument` if the size
+   * is out of range, `std::errc::io_error` if the firmware doesn't support
+   * it.
+   */
+  [[nodiscard]] hal::status set_ssl_buffer_size(std::uint16_t p_size,
+                                                deadline p_timeout);
+  /**
+   * @brief Look up the IP address of a domain with AT+CIPDOMAIN
+   *
+   * Returns the cached address without asking the module if the DNS cache is
+   * enabled and the address has not expired.
+   *
+   * @param p_domain - domain name, at most 64 characters
+   * @param p_timeout - deadline for the module to respond
+   * @return hal::result<std::string_view> - dotted IPv4 address, valid until
+   * the next call to `resolve()`
+   */
+  [[nodiscard]] hal::result<std::string_view> resolve(std::string_view p_domain,
+                                                      deadline p_timeout);
   [[nodiscard]] hal::status connect_to_server(socket_config p_config,
                                               deadline p_timeout);
   [[nodiscard]] hal::result<bool> is_connected_to_server(deadline p_timeout);
+  /**
+   * @brief Send data to the server
+   *
+   * Data of any length is accepted. Anything beyond the module's 2048 byte
+   * limit for AT+CIPSEND is split into a series of full 2048 byte segments,
+   * each sent as soon as the module has confirmed the one before it.
+   *
+   * @param p_data - data to send
+   * @param p_timeout - deadline for the whole of the data to be sent
+   * @return hal::result<write_t> - the data that was sent
+   */
   [[nodiscard]] hal::result<write_t> server_write(
     std::span<const hal::byte> p_data,
     deadline p_timeout);
+  /**
+   * @brief Queue data in the module's TCP send buffer with AT+CIPSENDBUF
+   *
+   * Returns as soon as the module has taken the data rather than waiting for
+   * the server to acknowledge it, so several segments can be in flight at
+   * once. Each 2048 bytes of data is one segment. Segments are numbered from
+   * 1 at the start of each connection and the module reports them as sent
+   * in order, which is tracked by `acknowledged_segments()`. If the send
+   * window is full, this waits for the oldest segment to be acknowledged
+   * first. Only available for TCP in single connection mode.
+   *
+   * @param p_data - data to send
+   * @param p_timeout - deadline for the data to be queued
+   * @return hal::result<std::uint32_t> - number of the last segment queued
+   */
+  [[nodiscard]] hal::result<std::uint32_t> server_write_buffered(
+    std::span<const hal::byte> p_data,
+    deadline p_timeout);
+  /**
+   * @brief Wait until a buffered segment and all before it have been sent
+   *
+   * @param p_segment - segment number from `server_write_buffered()`
+   * @param p_timeout - deadline for the segments to be acknowledged
+   * @return hal::status - success, or `std::errc::io_error` if any segment
+   * failed to send on this connection
+   */
+  [[nodiscard]] hal::status wait_for_segments(std::uint32_t p_segment,
+                                              deadline p_timeout);
+  /**
+   * @brief Set the number of buffered segments allowed in flight at once
+   *
+   * @param p_segments - window size, at least 1 (default is 4)
+   */
+  void set_send_window(std::uint8_t p_segments);
+  /**
+   * @return std::uint32_t - number of buffered segments the module has
+   * finished sending, successfully or not
+   */
+  [[nodiscard]] std::uint32_t acknowledged_segments() const;
+  /**
+   * @return std::uint32_t - number of buffered segments that failed to send
+   */
+  [[nodiscard]] std::uint32_t failed_segments() const;
+  /**
+   * @brief Read data from the server that has already arrived
+   *
+   * Like every call that scans the response stream, this returns
+   * `std::errc::device_or_resource_busy` while an operation from `start_*()`
+   * has not terminated, so the responses it waits for are left in place.
+   *
+   * @param p_data - buffer to read data into
+   * @return hal::result<read_t> - the bytes read
+   */
   [[nodiscard]] hal::result<read_t> server_read(std::span<hal::byte> p_data);
+  /**
+   * @brief Read data from the server, pulling it from the module if needed
+   *
+   * In active receive mode this is the same as `server_read(p_data)`. In
+   * passive receive mode, after any buffered data is handed over, the
+   * remaining space in `p_data` is requested from the module with
+   * AT+CIPRECVDATA, limited to the amount the module has announced.
+   *
+   * @param p_data - buffer to read data into
+   * @param p_timeout - deadline for the module to respond to AT+CIPRECVDATA
+   * @return hal::result<read_t> - the bytes read, or
+   * `std::errc::device_or_resource_busy` while an operation from `start_*()`
+   * has not terminated
+   */
+  [[nodiscard]] hal::result<read_t> server_read(std::span<hal::byte> p_data,
+                                                deadline p_timeout);
+  /**
+   * @brief Lend out payload data received from the server without copying
+   *
+   * Pulls any pending payload from the serial port into the driver's receive
+   * buffer and returns a view of the oldest unreleased bytes. The view stays
+   * valid until `release_read()` or any other call on this driver that reads
+   * from the serial port. Data that wraps around the end of the buffer is
+   * returned by the next call after the first part is released.
+   *
+   * @return hal::result<std::span<const hal::byte>> - contiguous received
+   * bytes, empty if nothing has been received.
+   * `std::errc::device_or_resource_busy` while an operation from `start_*()`
+   * has not terminated.
+   */
+  [[nodiscard]] hal::result<std::span<const hal::byte>> acquire_read();
+  /**
+   * @brief Return bytes lent by `acquire_read()` to the receive buffer
+   *
+   * @param p_length - number of bytes from the start of the last acquired
+   * span that are no longer needed
+   */
+  void release_read(std::size_t p_length);
+  /**
+   * @brief Send one UDP datagram to a specific address
+   *
+   * Uses the remote address form of AT+CIPSEND, so the connection must be
+   * UDP and opened with a `local_port` to reach addresses other than the one
+   * it was opened with.
+   *
+   * @param p_data - payload, sent as a single datagram
+   * @param p_address - dotted IPv4 address to send to
+   * @param p_port - port to send to
+   * @param p_timeout - deadline for the module to send the datagram
+   * @return hal::result<write_t> - the bytes sent,
+   * `std::errc::invalid_argument` if the payload is too large for one
+   * datagram or the address is not an IPv4 address.
+   */
+  [[nodiscard]] hal::result<write_t> send_to(std::span<const hal::byte> p_data,
+                                             std::string_view p_address,
+                                             std::uint16_t p_port,
+                                             deadline p_timeout);
+  /**
+   * @brief Receive one whole UDP datagram along with its sender
+   *
+   * UDP connections keep each datagram separate in the receive buffer, and a
+   * datagram that arrives while this is called is read straight into
+   * `p_buffer`. Bytes that don't fit in `p_buffer` are dropped. A datagram
+   * that arrives while the receive buffer is full waits in the UART until
+   * the link is read, one larger than the link's receive buffer is dropped
+   * and reported by the next call. `read()` on a UDP connection also returns
+   * one datagram at a time. Without a deadline it never waits, a datagram
+   * that is still arriving is kept in the receive buffer and returned by a
+   * later call. `acquire_read()` is not supported.
+   *
+   * @param p_buffer - buffer to receive the payload into
+   * @param p_timeout - deadline for the rest of a datagram to arrive once its
+   * header has been seen
+   * @return hal::result<datagram> - the datagram, with empty data if none has
+   * arrived. `std::errc::invalid_argument` if the connection is not UDP.
+   * `std::errc::message_size` once after datagrams too large for the link's
+   * receive buffer were dropped. `std::errc::device_or_resource_busy` while
+   * an operation from `start_*()` has not terminated.
+   */
+  [[nodiscard]] hal::result<datagram> receive_from(
+    std::span<hal::byte> p_buffer,
+    deadline p_timeout);
+  /**
+   * @brief Include the sender's address in +IPD headers with AT+CIPDINFO
+   *
+   * @param p_enabled - true to have the module send the address and port
+   * @param p_timeout - deadline for the module to respond
+   * @return hal::status - success or failure
+   */
+  [[nodiscard]] hal::status set_remote_info(bool p_enabled,
+                                            deadline p_timeout);
   [[nodiscard]] hal::status disconnect_from_server(deadline p_timeout);
 
+  // Multiple connection commands
+  /**
+   * @brief Switch between single and multiple connection mode
+   *
+   * The module only allows this while no connections are open. Anything left
+   * in the receive buffer is discarded as it is re-split between the links.
+   *
+   * @param p_mode - connection mode to use
+   * @param p_timeout - deadline for the module to respond
+   * @return hal::status - success or failure
+   */
+  [[nodiscard]] hal::status set_connection_mode(connection_mode p_mode,
+                                                deadline p_timeout);
+  /**
+   * @brief Choose how much of the receive buffer each link gets in multiple
+   * connection mode
+   *
+   * By default the buffer passed to `create()` is split evenly. Links that
+   * carry most of the traffic can be given more of it, and links that are
+   * never used can be given none. Payload for a link with no space is left
+   * in the serial port until that link is read. Anything left in the
+   * receive buffer is discarded if multiple connection mode is in use.
+   *
+   * @param p_sizes - bytes for each link, by link id
+   * @return hal::status - success, `std::errc::invalid_argument` if the sizes
+   * add up to more than the receive buffer
+   */
+  [[nodiscard]] hal::status set_link_buffer_sizes(
+    std::array<std::uint16_t, maximum_links> p_sizes);
+  /**
+   * @brief Get a link to operate on
+   *
+   * @param p_id - link id, must be 0 in single connection mode and less than
+   * `maximum_links` in multiple connection mode.
+   * @return hal::result<link> - the link or std::errc::invalid_argument if the
+   * id is not available in the current connection mode.
+   */
+  [[nodiscard]] hal::result<link> get_link(std::uint8_t p_id);
+
+  // TCP server commands
+  /**
+   * @brief Accept TCP connections on a port with AT+CIPSERVER
+   *
+   * The module only runs a server in multiple connection mode. Each client
+   * is given a free link id and announced with `<link>,CONNECT`, which is
+   * reported to the event handler and queued for `accept()`.
+   *
+   * @param p_port - port to listen on
+   * @param p_timeout - deadline for the module to respond
+   * @return hal::status - success, `std::errc::operation_not_permitted` if
+   * the driver is in single connection mode.
+   */
+  [[nodiscard]] hal::status start_server(std::uint16_t p_port,
+                                         deadline p_timeout);
+  /**
+   * @brief Stop accepting connections with AT+CIPSERVER=0
+   *
+   * Clients that have not been accepted yet are forgotten. The 1.7.x
+   * firmware only frees the port after a reset.
+   *
+   * @param p_timeout - deadline for the module to respond
+   * @return hal::status - success or failure
+   */
+  [[nodiscard]] hal::status stop_server(deadline p_timeout);
+  /**
+   * @brief Set how long the server keeps an idle client with AT+CIPSTO
+   *
+   * @param p_idle_time - time without traffic before the module closes a
+   * client's connection, rounded down to whole seconds. Zero never closes
+   * it.
+   * @param p_timeout - deadline for the module to respond
+   * @return hal::status - success, `std::errc::invalid_argument` if
+   * `p_idle_time` is over the module's limit of 7200s.
+   */
+  [[nodiscard]] hal::status set_server_timeout(hal::time_duration p_idle_time,
+                                               deadline p_timeout);
+  /**
+   * @brief Take the next client that connected to the server
+   *
+   * Notifications that have already arrived are processed first, so this
+   * can be polled without waiting on any other call.
+   *
+   * @return hal::result<link> - the client's link, lowest link id first.
+   * `std::errc::resource_unavailable_try_again` if no client is waiting.
+   * `std::errc::device_or_resource_busy` while an operation from `start_*()`
+   * has not terminated.
+   */
+  [[nodiscard]] hal::result<link> accept();
+
+  /**
+   * @brief Choose whether TCP payload is pushed by the module or pulled
+   *
+   * In passive mode the module keeps received data in its own buffer and
+   * announces it with `+IPD,[<link>,]<length>`. Data is then only sent to the
+   * host when requested by `server_read(p_data, p_timeout)` or
+   * `link::read(p_data, p_timeout)`, so the host never receives more than it
+   * has room for and the module applies TCP backpressure to the sender.
+   *
+   * @param p_mode - receive mode to use
+   * @param p_timeout - deadline for the module to respond
+   * @return hal::status - success or failure
+   */
+  [[nodiscard]] hal::status set_receive_mode(receive_mode p_mode,
+                                             deadline p_timeout);
+
+  // Non-blocking variants of the commands above
+  //
+  // Each returns a handle once the command has been written, or
+  // `std::errc::device_or_resource_busy` if another operation has not yet
+  // terminated. See `operation` for how to drive them.
+  [[nodiscard]] hal::result<operation> start_reset();
+  [[nodiscard]] hal::result<operation> start_connect_to_ap(
+    std::string_view p_ssid,
+    std::string_view p_password,
+    std::string_view p_bssid = "");
+  [[nodiscard]] hal::result<operation> start_set_ip_address(
+    std::string_view p_ip);
+  [[nodiscard]] hal::result<operation> start_is_connected_to_ap();
+  [[nodiscard]] hal::result<operation> start_disconnect_from_ap();
+  [[nodiscard]] hal::result<operation> start_connect_to_server(
+    socket_config p_config);
+  [[nodiscard]] hal::result<operation> start_is_connected_to_server();
+  [[nodiscard]] hal::result<operation> start_server_write(
+    std::span<const hal::byte> p_data);
+  [[nodiscard]] hal::result<operation> start_disconnect_from_server();
+  /**
+   * @return true - while an operation from `start_*()` has not terminated
+   */
+  [[nodiscard]] bool is_busy() const;
+
+  // Transparent transmission commands
+  /**
+   * @brief Switch the open connection to transparent transmission
+   *
+   * Enables AT+CIPMODE=1 and starts an unbounded AT+CIPSEND. Only available
+   * in single connection mode with a TCP or UDP connection open. Any payload
+   * still held in the receive buffer should be read before calling this.
+   *
+   * @param p_timeout - deadline for the module to respond
+   * @return hal::result<transparent_stream> - stream to exchange data with the
+   * server through.
+   */
+  [[nodiscard]] hal::result<transparent_stream> start_transparent_mode(
+    deadline p_timeout);
+  /**
+   * @brief Leave transparent transmission and return to AT commands
+   *
+   * The module only treats "+++" as the exit sequence if it is surrounded by
+   * silence on the UART, so nothing may be written to the transparent stream
+   * from the start of this call until it returns.
+   *
+   * @param p_guard_before - deadline that expires once the UART has been idle
+   * long enough before "+++" (1s for the 1.7.x firmware)
+   * @param p_guard_after - deadline that expires once enough time has passed
+   * after "+++" for the module to accept commands again (1s for the 1.7.x
+   * firmware)
+   * @param p_timeout - deadline for the module to respond to AT+CIPMODE=0
+   * @return hal::status - success or failure
+   */
+  [[nodiscard]] hal::status stop_transparent_mode(deadline p_guard_before,
+                                                  deadline p_guard_after,
+                                                  deadline p_timeout);
+
 private:
   class packet_manager
   {
   public:
     packet_manager();
-    void find(hal::serial& p_serial);
+    hal::status find_fields(hal::serial& p_serial);
     bool is_complete_header();
+    bool is_in_fields();
+    bool is_expecting_header();
+    bool is_new_packet();
+    void claim();
     std::uint16_t packet_length();
+    std::string_view remote_address();
+    std::uint16_t remote_port();
+    std::uint32_t pending(std::uint8_t p_link);
+    void set_pending(std::uint8_t p_link, std::uint32_t p_length);
     hal::result<std::span<hal::byte>> read_packet(
       hal::serial& p_serial,
       std::span<hal::byte> p_buffer);
+    std::uint8_t link();
+    hal::result<std::span<const hal::byte>> fill(hal::serial& p_serial);
+    std::span<const hal::byte> buffered();
+    void consume(std::size_t p_count);
+    void discard();
     void reset();
-    void set_state(std::uint8_t p_state);
+    void start_fields();
+    void set_multiplexed(bool p_multiplexed);
+    void set_lossless(bool p_lossless);
+    bool is_malformed();
 
   private:
+    /// Number of bytes pulled from the serial port per read while searching
+    /// for packet headers.
+    static constexpr std::size_t window_size = 128;
+
     void update_state(hal::byte p_byte);
+    void abandon_fields();
+    std::array<hal::byte, window_size> m_window{};
+    std::uint16_t m_window_start;
+    std::uint16_t m_window_end;
     std::uint8_t m_state;
+    std::uint8_t m_link;
+    std::uint8_t m_field;
+    std::uint8_t m_digits;
+    bool m_multiplexed;
+    bool m_lossless;
     std::uint16_t m_length;
+    /// Length given by the header, to tell whether any payload has been read
+    std::uint16_t m_announced;
+    /// Set once the packet has been taken before any payload was read
+    bool m_claimed;
+    /// Sender of the packet, present with AT+CIPDINFO=1
+    std::array<char, 15> m_remote_address{};
+    std::uint8_t m_remote_length;
+    std::uint32_t m_remote_port;
+    /// Bytes announced by passive mode notifications that are still held by
+    /// the module for each link
+    std::array<std::uint32_t, maximum_links> m_pending{};
+  };
+
+  /// Commands that can be run as an `operation`, see at.cpp
+  enum class operation_kind : std::uint8_t;
+
+  /// Progress and arguments of the operation in flight
+  struct operation_context
+  {
+    operation_kind kind;
+    hal::work_state state = hal::work_state::finished;
+    /// Index of the command or response the operation is waiting on
+    std::uint8_t step = 0;
+    std::uint8_t link = 0;
+    /// Set while the digits following a response are being read
+    bool reading_integer = false;
+    bool result = false;
+    std::uint32_t integer = 0;
+    std::array<std::string_view, 3> text{};
+    socket_config config{};
+    std::span<const hal::byte> data{};
+    /// Bytes of `data` the module has confirmed with SEND OK
+    std::size_t sent = 0;
+  };
+
+  /// Domain and the address it resolved to
+  struct dns_entry
+  {
+    std::array<char, 64> domain{};
+    std::array<char, 15> address{};
+    std::uint8_t domain_length = 0;
+    std::uint8_t address_length = 0;
+    /// Uptime in ticks after which the address is looked up again
+    std::uint64_t expires = 0;
+  };
+
+  /// Ring buffer indices over a region of `m_receive_storage`
+  class receive_ring
+  {
+  public:
+    receive_ring(std::uint16_t p_offset = 0, std::uint16_t p_capacity = 0);
+    std::span<hal::byte> writable(std::span<hal::byte> p_storage);
+    void commit(std::size_t p_length);
+    std::span<hal::byte> readable(std::span<hal::byte> p_storage);
+    void release(std::size_t p_length);
+    void write(std::span<hal::byte> p_storage,
+               std::span<const hal::byte> p_data);
+    std::size_t read(std::span<hal::byte> p_storage,
+                     std::span<hal::byte> p_buffer);
+    std::size_t peek(std::span<hal::byte> p_storage,
+                     std::span<hal::byte> p_buffer);
+    void discard(std::size_t p_length);
+    std::size_t size();
+    std::size_t available();
+    std::size_t capacity();
+
+  private:
+    std::uint16_t m_offset;
+    std::uint16_t m_capacity;
+    std::uint16_t m_read;
+    std::uint16_t m_count;
   };
 
   /**
    * @param p_serial the serial port connected to the wlan_client
    *
    */
-  at(hal::serial& p_serial);
+  at(hal::serial& p_serial, std::span<hal::byte> p_receive_buffer);
+
+  [[nodiscard]] hal::status receive_packets();
+  [[nodiscard]] hal::status resume_session(deadline p_timeout);
+  void use_connection_mode(connection_mode p_mode);
+  void forget_session();
+  [[nodiscard]] hal::status link_connect(std::uint8_t p_link,
+                                         socket_config p_config,
+                                         deadline p_timeout);
+  [[nodiscard]] hal::result<bool> link_is_connected(std::uint8_t p_link,
+                                                    deadline p_timeout);
+  [[nodiscard]] hal::result<write_t> link_write(
+    std::uint8_t p_link,
+    std::span<const hal::byte> p_data,
+    deadline p_timeout);
+  [[nodiscard]] hal::result<read_t> link_read(std::uint8_t p_link,
+                                              std::span<hal::byte> p_data);
+  [[nodiscard]] hal::result<read_t> link_read(std::uint8_t p_link,
+                                              std::span<hal::byte> p_data,
+                                              deadline p_timeout);
+  [[nodiscard]] hal::result<std::size_t> link_pull(std::uint8_t p_link,
+                                                   std::span<hal::byte> p_data,
+                                                   deadline p_timeout);
+  [[nodiscard]] hal::result<std::span<const hal::byte>> link_acquire_read(
+    std::uint8_t p_link);
+  [[nodiscard]] hal::result<write_t> link_send_to(
+    std::uint8_t p_link,
+    std::span<const hal::byte> p_data,
+    std::string_view p_address,
+    std::uint16_t p_port,
+    deadline p_timeout);
+  [[nodiscard]] hal::result<datagram> link_receive_from(
+    std::uint8_t p_link,
+    std::span<hal::byte> p_buffer,
+    deadline p_timeout);
+  [[nodiscard]] hal::result<datagram> poll_datagram(
+    std::uint8_t p_link,
+    std::span<hal::byte> p_buffer);
+  bool pop_datagram(std::uint8_t p_link,
+                    std::span<hal::byte> p_buffer,
+                    datagram& p_received);
+  [[nodiscard]] bool is_datagram_link(std::uint8_t p_link) const;
+  [[nodiscard]] hal::result<std::size_t> park_datagram();
+  [[nodiscard]] hal::status take_dropped_datagram(std::uint8_t p_link);
+  void link_release_read(std::uint8_t p_link, std::size_t p_length);
+  [[nodiscard]] hal::status link_set_ssl_auth(std::uint8_t p_link,
+                                              ssl_auth p_auth,
+                                              deadline p_timeout);
+  [[nodiscard]] hal::status link_disconnect(std::uint8_t p_link,
+                                            deadline p_timeout);
+  [[nodiscard]] hal::result<operation> start_link_connect(
+    std::uint8_t p_link,
+    socket_config p_config);
+  [[nodiscard]] hal::result<operation> start_link_is_connected(
+    std::uint8_t p_link);
+  [[nodiscard]] hal::result<operation> start_link_write(
+    std::uint8_t p_link,
+    std::span<const hal::byte> p_data);
+  [[nodiscard]] hal::result<operation> start_link_disconnect(
+    std::uint8_t p_link);
+  [[nodiscard]] hal::status claim_operation(operation_kind p_kind,
+                                            std::uint8_t p_link);
+  [[nodiscard]] hal::result<operation> begin_operation();
+  [[nodiscard]] hal::status write_operation_step();
+  [[nodiscard]] hal::result<hal::work_state> poll_operation();
+  void fail_operation();
+  [[nodiscard]] hal::status finish_operation(operation p_operation,
+                                             deadline p_timeout);
+  [[nodiscard]] hal::status write_uart_config(std::uint32_t p_baud_rate);
+  [[nodiscard]] hal::status configure_baud_rate(std::uint32_t p_baud_rate);
+  [[nodiscard]] hal::status switch_baud_rate(std::uint32_t p_baud_rate,
+                                             deadline p_timeout);
+
+  /// Responses recognized by the shared response matcher, see at.cpp
+  enum class response : std::uint8_t;
+
+  [[nodiscard]] hal::result<response> read_response(deadline p_timeout);
+  [[nodiscard]] hal::result<response> scan_response();
+  [[nodiscard]] hal::result<response> scan_tokens();
+  void remember(std::span<const hal::byte> p_bytes);
+  void dispatch_event(response p_token);
+  [[nodiscard]] hal::result<hal::work_state> advance_operation(
+    response p_response);
+  [[nodiscard]] static response operation_response(operation_kind p_kind,
+                                                   std::uint8_t p_step);
+  [[nodiscard]] hal::status wait_for(response p_response, deadline p_timeout);
+  [[nodiscard]] hal::result<std::uint32_t> read_integer(deadline p_timeout);
+  [[nodiscard]] hal::result<bool> scan_integer(std::uint32_t& p_value);
+  [[nodiscard]] hal::status read_exact(std::span<hal::byte> p_buffer,
+                                       deadline p_timeout);
+  [[nodiscard]] hal::status store_payload();
+  [[nodiscard]] dns_entry* find_dns_entry(std::string_view p_domain);
+  void forget_address(std::string_view p_domain);
 
   hal::serial* m_serial;
   packet_manager m_packet_manager;
+  std::array<receive_ring, maximum_links> m_receive{};
+  /// Caller provided storage for received payload, see `create()`
+  std::span<hal::byte> m_receive_storage;
+  connection_mode m_connection_mode;
+  receive_mode m_receive_mode;
+  std::uint32_t m_baud_rate;
+  /// Settings of the serial port, of which the driver only changes the baud
+  /// rate
+  hal::serial::settings m_serial_settings{};
+  flow_control m_flow_control;
+  operation_context m_operation{};
+  /// Partial response token carried between scans
+  std::uint8_t m_response_state;
+  std::uint8_t m_send_window;
+  std::uint32_t m_segments_queued;
+  std::uint32_t m_segments_acknowledged;
+  std::uint32_t m_segments_failed;
+  /// Last bytes of the response stream, the link id of a notification sits
+  /// just in front of it
+  std::array<hal::byte, 16> m_history{};
+  hal::callback<event_handler> m_event_handler{};
+  std::array<dns_entry, dns_cache_size> m_dns_cache{};
+  /// Clock to age DNS entries with, nullptr while the cache is disabled
+  hal::steady_clock* m_clock;
+  hal::time_duration m_dns_ttl;
+  /// Clock to time connections with, nullptr while not measuring
+  hal::steady_clock* m_connect_clock;
+  /// Uptime in ticks when the connection being opened was started
+  std::uint64_t m_connect_started;
+  hal::time_duration m_connect_time;
+  /// Bit per link that is a UDP connection, whose receive buffer holds whole
+  /// datagrams
+  std::uint8_t m_datagram_links;
+  /// Set when the rest of the packet being received is to be dropped
+  bool m_discard_packet;
+  /// Bit per UDP link that dropped a datagram too large for its receive
+  /// buffer, reported by the next receive on that link
+  std::uint8_t m_dropped_datagrams;
+  /// Set while the module is accepting connections
+  bool m_listening;
+  /// Bit per link that a client opened and `accept()` hasn't returned yet
+  std::uint8_t m_accept_queue;
+  /// Share of the receive buffer each link gets in multiple connection mode
+  std::array<std::uint16_t, maximum_links> m_link_buffer_sizes{};
 };
 }  // namespace hal::esp8266
@@ -0,0 +1,115 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include <libhal/steady_clock.hpp>
+#include <libhal/units.hpp>
+
+#include "at.hpp"
+
+namespace hal::esp8266 {
+/**
+ * @brief Batches small writes to a link into fewer, larger AT+CIPSEND calls
+ *
+ * Every `at::link::write()` costs a full AT+CIPSEND, prompt and SEND OK
+ * exchange with the module regardless of size, which dominates the cost of
+ * sending small records. This writer copies records into a buffer instead
+ * and only sends once one of the following happens:
+ *
+ *   1. The buffer holds at least the flush threshold
+ *   2. `flush()` is called
+ *   3. `poll()` is called after the oldest buffered byte has waited for the
+ *      maximum latency
+ *
+ * The driver has no timer of its own, so `poll()` must be called regularly
+ * from the application's main loop for the latency bound to hold.
+ */
+class coalescing_writer
+{
+public:
+  /// Largest amount of data sent with a single AT+CIPSEND
+  static constexpr std::size_t buffer_size = 2048;
+
+  /**
+   * @brief Create a coalescing writer for a link
+   *
+   * @param p_link - link to send the batched data over
+   * @param p_clock - clock used to measure how long data has been waiting
+   * @param p_threshold - buffered bytes that trigger a send, between 1 and
+   * `buffer_size`
+   * @param p_max_latency - longest time a byte may wait before `poll()` sends
+   * it
+   * @return hal::result<coalescing_writer> - the writer or
+   * `std::errc::invalid_argument` if the threshold is out of range
+   */
+  [[nodiscard]] static hal::result<coalescing_writer> create(
+    at::link p_link,
+    hal::steady_clock& p_clock,
+    std::size_t p_threshold,
+    hal::time_duration p_max_latency);
+
+  /**
+   * @brief Add a record to the batch, sending the batch if it is full
+   *
+   * A record that doesn't fit in the space left sends the batch first.
+   * Records larger than the whole buffer are sent straight away after the
+   * batch.
+   *
+   * @param p_data - record to send
+   * @param p_timeout - deadline for any sends this causes
+   * @return hal::status - success or failure
+   */
+  [[nodiscard]] hal::status write(std::span<const hal::byte> p_data,
+                                  at::deadline p_timeout);
+  /**
+   * @brief Send everything that has been buffered
+   *
+   * @param p_timeout - deadline for the send
+   * @return hal::status - success or failure
+   */
+  [[nodiscard]] hal::status flush(at::deadline p_timeout);
+  /**
+   * @brief Send the batch if its oldest byte has waited the maximum latency
+   *
+   * @param p_timeout - deadline for the send, if one is needed
+   * @return hal::status - success or failure
+   */
+  [[nodiscard]] hal::status poll(at::deadline p_timeout);
+  /**
+   * @return std::size_t - number of bytes waiting to be sent
+   */
+  [[nodiscard]] std::size_t size() const;
+
+private:
+  coalescing_writer(at::link p_link,
+                    hal::steady_clock& p_clock,
+                    std::size_t p_threshold,
+                    hal::time_duration p_max_latency);
+
+  at::link m_link;
+  hal::steady_clock* m_clock;
+  std::size_t m_threshold;
+  hal::time_duration m_max_latency;
+  /// Uptime ticks at which the oldest buffered byte is due to be sent
+  std::uint64_t m_deadline;
+  std::size_t m_length;
+  std::array<hal::byte, buffer_size> m_buffer{};
+};
+}  // namespace hal::esp8266
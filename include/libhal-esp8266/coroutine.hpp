@@ -0,0 +1,408 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <utility>
+
+#include <libhal/error.hpp>
+#include <libhal/units.hpp>
+
+#include "at.hpp"
+
+namespace hal::esp8266 {
+/**
+ * @brief Work that a `task` can wait on without blocking
+ */
+class awaitable_work
+{
+public:
+  /**
+   * @brief Make as much progress as possible without waiting
+   *
+   * @return hal::work_state - `in_progress` until the waiting task may be
+   * resumed
+   */
+  virtual hal::work_state poll() = 0;
+
+protected:
+  ~awaitable_work() = default;
+};
+
+/**
+ * @brief Coroutine running one logical flow of network operations
+ *
+ * A task starts suspended and only runs when `resume()` is called, so any
+ * number of tasks can share one `at` driver by resuming each of them in turn
+ * from the application's main loop. A task that is waiting on the module
+ * only polls the driver when resumed and gives control straight back if the
+ * module has not answered yet. When tasks want the driver at the same time,
+ * each operation waits until the one before it has finished.
+ *
+ * Each task allocates its coroutine frame with operator new.
+ *
+ * Usage:
+ *
+ *    hal::esp8266::task upload(hal::esp8266::at& p_esp8266) {
+ *      auto timeout = hal::create_timeout(clock, 1s);
+ *      auto sent = co_await async_server_write(p_esp8266, data, timeout);
+ *      if (!sent) {
+ *        co_return sent;
+ *      }
+ *      co_return hal::success();
+ *    }
+ */
+class task
+{
+public:
+  struct promise_type
+  {
+    task get_return_object()
+    {
+      return task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    std::suspend_always initial_suspend() noexcept
+    {
+      return {};
+    }
+
+    std::suspend_always final_suspend() noexcept
+    {
+      return {};
+    }
+
+    void return_value(hal::status p_status)
+    {
+      m_status = std::move(p_status);
+    }
+
+    void unhandled_exception()
+    {
+      std::terminate();
+    }
+
+    /// Work the task is suspended on, if any
+    awaitable_work* m_waiting = nullptr;
+    hal::status m_status{};
+  };
+
+  task(task&& p_other) noexcept
+    : m_handle(std::exchange(p_other.m_handle, {}))
+  {
+  }
+
+  task& operator=(task&& p_other) = delete;
+  task(const task&) = delete;
+  task& operator=(const task&) = delete;
+
+  ~task()
+  {
+    if (m_handle) {
+      m_handle.destroy();
+    }
+  }
+
+  /**
+   * @brief Run the task until it has to wait on the module again
+   *
+   * @return hal::work_state - `in_progress` until the task has returned, then
+   * `finished` or `failed` depending on the status it returned
+   */
+  hal::work_state resume()
+  {
+    if (m_handle.done()) {
+      return state();
+    }
+
+    auto& promise = m_handle.promise();
+    if (promise.m_waiting != nullptr) {
+      if (promise.m_waiting->poll() == hal::work_state::in_progress) {
+        return hal::work_state::in_progress;
+      }
+      promise.m_waiting = nullptr;
+    }
+
+    m_handle.resume();
+    return state();
+  }
+
+  [[nodiscard]] hal::work_state state() const
+  {
+    if (!m_handle.done()) {
+      return hal::work_state::in_progress;
+    }
+    return m_handle.promise().m_status ? hal::work_state::finished
+                                       : hal::work_state::failed;
+  }
+
+  /**
+   * @return hal::status& - status returned by the task once it has finished
+   */
+  [[nodiscard]] hal::status& status()
+  {
+    return m_handle.promise().m_status;
+  }
+
+private:
+  explicit task(std::coroutine_handle<promise_type> p_handle)
+    : m_handle(p_handle)
+  {
+  }
+
+  std::coroutine_handle<promise_type> m_handle;
+};
+
+/**
+ * @brief Awaitable running an operation from one of the driver's `start_*()`
+ * methods
+ *
+ * `co_await` gives back a `hal::status` with the outcome of the operation.
+ * The timeout is checked each time the task is resumed, including while the
+ * operation waits for another task to free the driver. An operation that is
+ * still in progress when the awaitable is destroyed is cancelled.
+ *
+ * @tparam start_function - callable returning `hal::result<at::operation>`
+ */
+template<class start_function>
+class operation_awaiter final : public awaitable_work
+{
+public:
+  operation_awaiter(at& p_driver,
+                    start_function p_start,
+                    at::deadline p_timeout)
+    : m_driver(&p_driver)
+    , m_start(std::move(p_start))
+    , m_timeout(p_timeout)
+  {
+  }
+
+  operation_awaiter(const operation_awaiter&) = delete;
+  operation_awaiter& operator=(const operation_awaiter&) = delete;
+
+  ~operation_awaiter()
+  {
+    if (m_operation && m_state == hal::work_state::in_progress) {
+      m_operation->cancel();
+    }
+  }
+
+  bool await_ready()
+  {
+    return false;
+  }
+
+  void await_suspend(std::coroutine_handle<task::promise_type> p_task)
+  {
+    p_task.promise().m_waiting = this;
+  }
+
+  hal::status await_resume()
+  {
+    return std::move(m_status);
+  }
+
+  hal::work_state poll() override
+  {
+    m_state = advance();
+    return m_state;
+  }
+
+private:
+  hal::work_state advance()
+  {
+    if (!m_operation) {
+      // Another task is using the driver
+      if (m_driver->is_busy()) {
+        return check_timeout();
+      }
+
+      auto started = m_start();
+      if (!started) {
+        m_status = started.error();
+        return hal::work_state::failed;
+      }
+      m_operation.emplace(started.value());
+    }
+
+    auto state = m_operation->poll();
+    if (!state) {
+      m_status = state.error();
+      return hal::work_state::failed;
+    }
+
+    if (state.value() == hal::work_state::in_progress) {
+      auto timed_out = check_timeout();
+      if (timed_out == hal::work_state::failed && m_operation) {
+        m_operation->cancel();
+      }
+      return timed_out;
+    }
+
+    return state.value();
+  }
+
+  hal::work_state check_timeout()
+  {
+    auto timeout = m_timeout();
+    if (!timeout) {
+      m_status = timeout.error();
+      return hal::work_state::failed;
+    }
+    return hal::work_state::in_progress;
+  }
+
+  at* m_driver;
+  start_function m_start;
+  at::deadline m_timeout;
+  std::optional<at::operation> m_operation{};
+  hal::work_state m_state = hal::work_state::in_progress;
+  hal::status m_status{};
+};
+
+/**
+ * @brief Awaitable that completes once payload has been read from the server
+ *
+ * `co_await` gives back a `hal::result<at::read_t>` holding at least one
+ * byte, or the timeout's error if nothing arrived in time.
+ */
+class read_awaiter final : public awaitable_work
+{
+public:
+  read_awaiter(at& p_driver,
+               std::span<hal::byte> p_buffer,
+               at::deadline p_timeout)
+    : m_driver(&p_driver)
+    , m_buffer(p_buffer)
+    , m_timeout(p_timeout)
+  {
+  }
+
+  bool await_ready()
+  {
+    return false;
+  }
+
+  void await_suspend(std::coroutine_handle<task::promise_type> p_task)
+  {
+    p_task.promise().m_waiting = this;
+  }
+
+  hal::result<at::read_t> await_resume()
+  {
+    return std::move(m_result);
+  }
+
+  hal::work_state poll() override
+  {
+    // Reading while another task's command is in flight would consume the
+    // response it is waiting for.
+    if (!m_driver->is_busy()) {
+      auto read = m_driver->server_read(m_buffer);
+      if (!read) {
+        m_result = read.error();
+        return hal::work_state::failed;
+      }
+
+      if (!read.value().data.empty()) {
+        m_result = read.value();
+        return hal::work_state::finished;
+      }
+    }
+
+    auto timeout = m_timeout();
+    if (!timeout) {
+      m_result = timeout.error();
+      return hal::work_state::failed;
+    }
+
+    return hal::work_state::in_progress;
+  }
+
+private:
+  at* m_driver;
+  std::span<hal::byte> m_buffer;
+  at::deadline m_timeout;
+  hal::result<at::read_t> m_result = at::read_t{};
+};
+
+/**
+ * @brief Awaitable form of `at::connect_to_ap()`
+ *
+ * The strings and the timeout must stay valid until the awaitable has
+ * completed.
+ */
+[[nodiscard]] inline auto async_connect_to_ap(at& p_driver,
+                                              std::string_view p_ssid,
+                                              std::string_view p_password,
+                                              at::deadline p_timeout)
+{
+  return operation_awaiter(
+    p_driver,
+    [&p_driver, p_ssid, p_password]() {
+      return p_driver.start_connect_to_ap(p_ssid, p_password);
+    },
+    p_timeout);
+}
+
+/**
+ * @brief Awaitable form of `at::connect_to_server()`
+ *
+ * The domain and the timeout must stay valid until the awaitable has
+ * completed.
+ */
+[[nodiscard]] inline auto async_connect_to_server(at& p_driver,
+                                                  at::socket_config p_config,
+                                                  at::deadline p_timeout)
+{
+  return operation_awaiter(
+    p_driver,
+    [&p_driver, p_config]() {
+      return p_driver.start_connect_to_server(p_config);
+    },
+    p_timeout);
+}
+
+/**
+ * @brief Awaitable form of `at::server_write()`
+ *
+ * The data and the timeout must stay valid until the awaitable has completed.
+ */
+[[nodiscard]] inline auto async_server_write(at& p_driver,
+                                             std::span<const hal::byte> p_data,
+                                             at::deadline p_timeout)
+{
+  return operation_awaiter(
+    p_driver,
+    [&p_driver, p_data]() { return p_driver.start_server_write(p_data); },
+    p_timeout);
+}
+
+/**
+ * @brief Awaitable form of `at::server_read()` that waits for data to arrive
+ *
+ * The timeout must stay valid until the awaitable has completed.
+ */
+[[nodiscard]] inline auto async_server_read(at& p_driver,
+                                            std::span<hal::byte> p_buffer,
+                                            at::deadline p_timeout)
+{
+  return read_awaiter(p_driver, p_buffer, p_timeout);
+}
+}  // namespace hal::esp8266
@@ -0,0 +1,146 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+
+#include <libhal/steady_clock.hpp>
+#include <libhal/units.hpp>
+
+#include "at.hpp"
+
+namespace hal::esp8266 {
+/**
+ * @brief Keeps the driver connected to an access point and a server
+ *
+ * The supervisor remembers whether the access point and the server are
+ * connected, so each call to `poll()` only runs the steps that are still
+ * needed. The module's notifications keep that knowledge up to date, which
+ * means the status queries are only sent when the state is unknown: at
+ * start up and after `connection_lost()`. Failed steps are retried after a
+ * delay that doubles with each consecutive failure, up to a maximum. The
+ * access point's BSSID is remembered after the first join so that rejoining
+ * it skips the channel scan.
+ *
+ * The supervisor does not install itself as the driver's event handler, so
+ * the application must forward events to `handle_event()`:
+ *
+ *    esp8266.on_event([&supervisor](auto p_event, auto p_link) {
+ *      supervisor.handle_event(p_event, p_link);
+ *    });
+ *
+ * The server is reached through `at::connect_to_server()`, which is link 0.
+ */
+class supervisor
+{
+public:
+  struct settings
+  {
+    std::string_view ssid;
+    std::string_view password;
+    /// Static network settings applied before joining, leave the IP address
+    /// empty to use DHCP
+    at::network_config network{};
+    at::socket_config server{};
+    /// Delay before retrying after the first failure
+    hal::time_duration min_backoff = std::chrono::milliseconds(500);
+    /// Longest delay between retries
+    hal::time_duration max_backoff = std::chrono::seconds(30);
+  };
+
+  /**
+   * @brief Create a supervisor for a driver
+   *
+   * The strings in `p_settings` must outlive the supervisor.
+   *
+   * @param p_driver - driver to keep connected
+   * @param p_clock - clock used to time the retries
+   * @param p_settings - access point, server and retry timing to use
+   * @return hal::result<supervisor> - the supervisor or
+   * `std::errc::invalid_argument` if the backoff range is empty
+   */
+  [[nodiscard]] static hal::result<supervisor> create(
+    at& p_driver,
+    hal::steady_clock& p_clock,
+    const settings& p_settings);
+
+  /**
+   * @brief Run the steps needed to get connected
+   *
+   * Does nothing while waiting to retry or while another operation is using
+   * the driver.
+   *
+   * @param p_timeout - deadline for the whole call. Every command sent during
+   * this poll shares it, so it must leave time for joining the access point
+   * and opening the server connection back to back.
+   * @return hal::work_state - `finished` once connected, otherwise
+   * `in_progress`
+   */
+  [[nodiscard]] hal::work_state poll(at::deadline p_timeout);
+  /**
+   * @brief Update the connection state from a driver event
+   *
+   * @param p_event - event passed to the driver's event handler
+   * @param p_link - link passed to the driver's event handler
+   */
+  void handle_event(at::event p_event, std::uint8_t p_link);
+  /**
+   * @brief Report that the server could not be reached
+   *
+   * Call this when a write or read fails. The next `poll()` checks the
+   * connection before deciding what to reconnect.
+   */
+  void connection_lost();
+  /**
+   * @return true - if both the access point and the server are connected
+   */
+  [[nodiscard]] bool is_connected() const;
+  /**
+   * @return std::uint32_t - number of failed steps since the last time the
+   * connection was established
+   */
+  [[nodiscard]] std::uint32_t failures() const;
+
+private:
+  enum class link_state : std::uint8_t
+  {
+    unknown,
+    down,
+    up,
+  };
+
+  supervisor(at& p_driver,
+             hal::steady_clock& p_clock,
+             const settings& p_settings);
+
+  hal::work_state retry_later();
+
+  at* m_driver;
+  hal::steady_clock* m_clock;
+  settings m_settings;
+  link_state m_ap;
+  link_state m_server;
+  hal::time_duration m_backoff;
+  /// Uptime ticks before which nothing is retried
+  std::uint64_t m_retry_at;
+  std::uint32_t m_failures;
+  /// BSSID of the last access point joined, to skip the scan when rejoining
+  std::array<char, 17> m_bssid{};
+  bool m_bssid_known;
+};
+}  // namespace hal::esp8266
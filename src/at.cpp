@@ -16,138 +16,308 @@
 
 #include <algorithm>
 #include <array>
+#include <chrono>
 #include <span>
+#include <utility>
 
 #include <libhal-util/serial.hpp>
-#include <libhal-util/streams.hpp>
-#include <libhal-util/timeout.hpp>
+#include <libhal-util/steady_clock.hpp>
 
 #include "util.hpp"
 
 namespace hal::esp8266 {
+enum class at::response : std::uint8_t
+{
+  none = 0,
+  ok,
+  error,
+  fail,
+  send_ok,
+  send_fail,
+  prompt,
+  ready,
+  packet,
+  ap_connected,
+  server_status,
+  receive_data,
+  busy,
+  segment_sent,
+  segment_failed,
+  segment_received,
+  connected,
+  link_connected,
+  closed,
+  link_closed,
+  wifi_connected,
+  wifi_got_ip,
+  wifi_disconnected,
+  domain_address,
+  mux_status,
+  receive_mode_status,
+  scan_entry,
+};
+
 namespace {
-[[nodiscard]] auto skip(hal::serial* p_serial, std::string_view p_string)
+/// Spin until a guard time deadline expires
+void wait_until_expired(at::deadline p_guard_time)
 {
-  return hal::skip_past(*p_serial, as_bytes(p_string));
+  while (p_guard_time()) {
+    continue;
+  }
 }
 
-[[nodiscard]] hal::status wait_for_ok(hal::serial* p_serial,
-                                      timeout auto p_timeout)
+// Order must match at::response
+constexpr std::array response_tokens{
+  ok_response,
+  error_response,
+  fail_response,
+  send_finished,
+  send_failed,
+  send_prompt,
+  reset_complete,
+  start_of_packet,
+  ap_connected_token,
+  server_status_token,
+  receive_data_token,
+  busy_processing,
+  segment_sent_token,
+  segment_failed_token,
+  segment_received_token,
+  connect_notice,
+  link_connect_notice,
+  closed_notice,
+  link_closed_notice,
+  wifi_connected_token,
+  got_ip_response,
+  wifi_disconnected_token,
+  domain_address_token,
+  mux_status_token,
+  receive_mode_status_token,
+  scan_entry_token,
+};
+constexpr auto response_automaton = make_token_automaton<response_tokens>();
+using response_matcher = token_matcher<response_automaton>;
+
+/// std::isdigit() is undefined for bytes above 0x7F once they are stored in
+/// a signed char, and the module can send any byte
+constexpr bool is_digit(hal::byte p_byte)
 {
-  // No need to check the worker state because skip never returns `failure`
-  HAL_CHECK(try_until(skip(p_serial, ok_response), p_timeout));
-  return hal::success();
+  return p_byte >= '0' && p_byte <= '9';
 }
 
-[[nodiscard]] hal::status wait_for_reset_complete(hal::serial* p_serial,
-                                                  timeout auto p_timeout)
+/// True for a dotted IPv4 address, which needs no DNS lookup
+bool is_ip_address(std::string_view p_host)
 {
-  // No need to check the worker state because skip never returns `failure`
-  HAL_CHECK(try_until(skip(p_serial, reset_complete), p_timeout));
-  return hal::success();
+  auto is_address_character = [](char p_character) {
+    return is_digit(static_cast<hal::byte>(p_character)) || p_character == '.';
+  };
+  return !p_host.empty() &&
+         std::all_of(p_host.begin(), p_host.end(), is_address_character);
+}
+
+/// Datagrams kept in a receive buffer are prefixed with their length, the
+/// sender's port and the length of the sender's address, all little endian,
+/// followed by the address itself:
+///
+///  <length:2><port:2><address length:1><address>
+constexpr std::size_t datagram_header_size = 5;
+
+/// Commands only carry the link id in multiple connection mode. The
+/// separators are only written along with the id.
+template<size_t capacity>
+void append_link_prefix(command_builder<capacity>& p_command,
+                        at::connection_mode p_mode,
+                        std::uint8_t p_link,
+                        std::string_view p_before = "",
+                        std::string_view p_after = ",")
+{
+  if (p_mode == at::connection_mode::multiple) {
+    p_command.append(p_before).append(p_link).append(p_after);
+  }
 }
 }  // namespace
 
+enum class at::operation_kind : std::uint8_t
+{
+  reset,
+  connect_to_ap,
+  set_ip_address,
+  is_connected_to_ap,
+  disconnect_from_ap,
+  link_connect,
+  link_is_connected,
+  link_write,
+  link_disconnect,
+};
+
 enum packet_manager_state : std::uint8_t
 {
   expect_plus,
-  expect_i,
-  expect_p,
-  expect_d,
-  expect_comma,
-  expect_digit1,
-  expect_digit2,
-  expect_digit3,
-  expect_digit4,
-  expect_colon,
-  header_complete
+  expect_field,
+  header_complete,
+  header_malformed
 };
 
 at::packet_manager::packet_manager()
-  : m_state(packet_manager_state::expect_plus)
+  : m_window_start(0)
+  , m_window_end(0)
+  , m_state(packet_manager_state::expect_plus)
+  , m_link(0)
+  , m_field(0)
+  , m_digits(0)
+  , m_multiplexed(false)
+  , m_lossless(false)
   , m_length(0)
+  , m_announced(0)
+  , m_claimed(false)
+  , m_remote_length(0)
+  , m_remote_port(0)
 {
 }
 
-void at::packet_manager::find(hal::serial& p_serial)
+hal::status at::packet_manager::find_fields(hal::serial& p_serial)
 {
-  if (is_complete_header()) {
-    return;
-  }
+  while (is_in_fields()) {
+    auto window = HAL_CHECK(fill(p_serial));
+    if (window.empty()) {
+      break;
+    }
 
-  std::array<hal::byte, 1> byte;
-  auto result = p_serial.read(byte);
-  while (result.has_value() && result.value().data.size() != 0) {
-    update_state(byte[0]);
-    if (is_complete_header()) {
-      return;
+    std::size_t scanned = 0;
+    for (auto byte : window) {
+      update_state(byte);
+      scanned++;
+      if (!is_in_fields()) {
+        break;
+      }
     }
-    result = p_serial.read(byte);
+
+    consume(scanned);
+  }
+
+  return hal::success();
+}
+
+hal::result<std::span<const hal::byte>> at::packet_manager::fill(
+  hal::serial& p_serial)
+{
+  if (m_window_start == m_window_end) {
+    m_window_start = 0;
+    m_window_end = 0;
+    auto bytes_read = HAL_CHECK(p_serial.read(m_window)).data;
+    m_window_end = static_cast<std::uint16_t>(bytes_read.size());
   }
+
+  return buffered();
+}
+
+std::span<const hal::byte> at::packet_manager::buffered()
+{
+  return std::span<const hal::byte>(m_window).subspan(
+    m_window_start, m_window_end - m_window_start);
 }
 
-void at::packet_manager::set_state(std::uint8_t p_state)
+void at::packet_manager::consume(std::size_t p_count)
 {
-  m_state = p_state;
+  auto unread = static_cast<std::size_t>(m_window_end - m_window_start);
+  m_window_start += static_cast<std::uint16_t>(std::min(p_count, unread));
+}
+
+void at::packet_manager::discard()
+{
+  m_window_start = 0;
+  m_window_end = 0;
+  reset();
+}
+
+void at::packet_manager::start_fields()
+{
+  m_state = packet_manager_state::expect_field;
+  m_link = 0;
+  m_field = 0;
+  m_digits = 0;
+  m_length = 0;
+  m_remote_length = 0;
+  m_remote_port = 0;
+}
+
+void at::packet_manager::set_multiplexed(bool p_multiplexed)
+{
+  m_multiplexed = p_multiplexed;
+  reset();
+}
+
+void at::packet_manager::set_lossless(bool p_lossless)
+{
+  m_lossless = p_lossless;
+}
+
+bool at::packet_manager::is_malformed()
+{
+  return m_state == packet_manager_state::header_malformed;
 }
 
 void at::packet_manager::update_state(hal::byte p_byte)
 {
   char c = static_cast<char>(p_byte);
+  // The length is the second field in multiple connection mode
+  std::uint8_t length_field = m_multiplexed ? 1 : 0;
+
   switch (m_state) {
-    case packet_manager_state::expect_plus:
-      if (c == '+') {
-        m_state = packet_manager_state::expect_i;
-      }
-      break;
-    case packet_manager_state::expect_i:
-      if (c == 'I') {
-        m_state = packet_manager_state::expect_p;
-      } else {
-        m_state = packet_manager_state::expect_plus;
-      }
-      break;
-    case packet_manager_state::expect_p:
-      if (c == 'P') {
-        m_state = packet_manager_state::expect_d;
-      } else {
-        m_state = packet_manager_state::expect_plus;
-      }
-      break;
-    case packet_manager_state::expect_d:
-      if (c == 'D') {
-        m_state = packet_manager_state::expect_comma;
-      } else {
-        m_state = packet_manager_state::expect_plus;
-      }
-      break;
-    case packet_manager_state::expect_comma:
-      if (c == ',') {
-        m_state = packet_manager_state::expect_digit1;
-        m_length = 0;  // Reset the length because we're about to parse it
-      } else {
-        m_state = packet_manager_state::expect_plus;
-      }
-      break;
-    case packet_manager_state::expect_digit1:
-    case packet_manager_state::expect_digit2:
-    case packet_manager_state::expect_digit3:
-    case packet_manager_state::expect_digit4:
-      if (isdigit(c)) {
-        m_length = m_length * 10 + (c - '0');  // Accumulate the length
-        m_state += 1;
-      } else if (c == ':') {
+    case packet_manager_state::expect_field:
+      // Single connection mode:   +IPD,<length>[,<ip>,<port>]:
+      // Multiple connection mode: +IPD,<link>,<length>[,<ip>,<port>]:
+      //
+      // The sender's address and port are only sent with AT+CIPDINFO=1.
+      if (m_field == length_field + 1) {
+        if ((is_digit(p_byte) || c == '.') &&
+            m_remote_length < m_remote_address.size()) {
+          m_remote_address[m_remote_length++] = c;
+        } else if (c == ',' && m_remote_length != 0) {
+          m_digits = 0;
+          m_field++;
+        } else {
+          abandon_fields();
+        }
+      } else if (m_field == length_field + 2) {
+        if (is_digit(p_byte) && m_digits < 5) {
+          m_remote_port = m_remote_port * 10 + (c - '0');
+          m_digits++;
+        } else if (c == ':' && m_digits != 0 && m_remote_port <= 0xFFFF) {
+          m_announced = m_length;
+          m_claimed = false;
+          m_state = packet_manager_state::header_complete;
+        } else {
+          abandon_fields();
+        }
+      } else if (is_digit(p_byte) && m_digits < 4) {
+        m_length = m_length * 10 + (c - '0');  // Accumulate the field
+        m_digits++;
+      } else if (m_digits == 0) {
+        // Every field must have at least one digit
+        abandon_fields();
+      } else if (c == ',' && m_multiplexed && m_field == 0 &&
+                 m_length < maximum_links) {
+        m_link = static_cast<std::uint8_t>(m_length);
+        m_length = 0;
+        m_digits = 0;
+        m_field++;
+      } else if (c == ',' && m_field == length_field) {
+        m_digits = 0;
+        m_field++;
+      } else if (c == ':' && m_field == length_field) {
+        m_announced = m_length;
+        m_claimed = false;
         m_state = packet_manager_state::header_complete;
-      } else {
-        // It's not a digit or a ':', so this is an error
+      } else if (c == '\r' && m_field == length_field) {
+        // Passive receive mode only announces the data held by the module:
+        //
+        //  +IPD,[<link>,]<length>\r\n
+        m_pending[m_link] += m_length;
         m_state = packet_manager_state::expect_plus;
-      }
-      break;
-    case packet_manager_state::expect_colon:
-      if (c == ':') {
-        m_state = packet_manager_state::header_complete;
       } else {
-        m_state = packet_manager_state::expect_plus;
+        // It's not a digit or an expected separator, so this is an error
+        abandon_fields();
       }
       break;
     default:
@@ -155,16 +325,71 @@ void at::packet_manager::update_state(hal::byte p_byte)
   }
 }
 
+void at::packet_manager::abandon_fields()
+{
+  // On a lossy link the header was most likely damaged in transit, so the
+  // best recovery is to look for the next one. A lossless link can't damage
+  // it, so that is left to the caller to report.
+  m_state = m_lossless ? packet_manager_state::header_malformed
+                       : packet_manager_state::expect_plus;
+}
+
 bool at::packet_manager::is_complete_header()
 {
   return m_state == packet_manager_state::header_complete;
 }
 
+bool at::packet_manager::is_expecting_header()
+{
+  return m_state == packet_manager_state::expect_plus;
+}
+
+bool at::packet_manager::is_in_fields()
+{
+  return m_state == packet_manager_state::expect_field;
+}
+
+bool at::packet_manager::is_new_packet()
+{
+  return is_complete_header() && !m_claimed && m_length == m_announced;
+}
+
+void at::packet_manager::claim()
+{
+  m_claimed = true;
+}
+
 std::uint16_t at::packet_manager::packet_length()
 {
   return is_complete_header() ? m_length : 0;
 }
 
+std::string_view at::packet_manager::remote_address()
+{
+  return std::string_view(m_remote_address.data(), m_remote_length);
+}
+
+std::uint16_t at::packet_manager::remote_port()
+{
+  return static_cast<std::uint16_t>(m_remote_port);
+}
+
+std::uint8_t at::packet_manager::link()
+{
+  return m_link;
+}
+
+std::uint32_t at::packet_manager::pending(std::uint8_t p_link)
+{
+  return m_pending[p_link];
+}
+
+void at::packet_manager::set_pending(std::uint8_t p_link,
+                                     std::uint32_t p_length)
+{
+  m_pending[p_link] = p_length;
+}
+
 hal::result<std::span<hal::byte>> at::packet_manager::read_packet(
   hal::serial& p_serial,
   std::span<hal::byte> p_buffer)
@@ -173,270 +398,2640 @@ hal::result<std::span<hal::byte>> at::packet_manager::read_packet(
     return p_buffer.first(0);
   }
 
-  auto buffer_size = static_cast<std::uint16_t>(p_buffer.size());
-  auto bytes_capable_of_reading = std::min(m_length, buffer_size);
+  auto bytes_capable_of_reading =
+    std::min(static_cast<std::size_t>(m_length), p_buffer.size());
   auto subspan = p_buffer.first(bytes_capable_of_reading);
-  auto bytes_read_array = HAL_CHECK(p_serial.read(subspan)).data;
 
-  m_length = m_length - bytes_read_array.size();
+  // Payload that was pulled in along with the header is handed over first
+  auto buffered = static_cast<std::size_t>(m_window_end - m_window_start);
+  auto from_window = std::min(buffered, subspan.size());
+  std::copy_n(m_window.begin() + m_window_start, from_window, subspan.begin());
+  consume(from_window);
+
+  auto bytes_read = from_window;
+  if (bytes_read < subspan.size()) {
+    // The window is drained, so the rest can go straight into the caller's
+    // buffer.
+    auto read_result = p_serial.read(subspan.subspan(bytes_read));
+    if (read_result) {
+      bytes_read += read_result.value().data.size();
+    } else if (bytes_read == 0) {
+      return read_result.error();
+    }
+  }
+
+  m_length = m_length - static_cast<std::uint16_t>(bytes_read);
 
   if (m_length == 0) {
     reset();
   }
 
-  return bytes_read_array;
+  return p_buffer.first(bytes_read);
 }
 
 void at::packet_manager::reset()
 {
   m_state = packet_manager_state::expect_plus;
+  m_link = 0;
   m_length = 0;
 }
 
-// constructor
-at::at(hal::serial& p_serial)
-  : m_serial(&p_serial)
-  , m_packet_manager{}
+at::receive_ring::receive_ring(std::uint16_t p_offset,
+                               std::uint16_t p_capacity)
+  : m_offset(p_offset)
+  , m_capacity(p_capacity)
+  , m_read(0)
+  , m_count(0)
 {
 }
 
-result<at> at::create(hal::serial& p_serial, deadline p_timeout)
+std::span<hal::byte> at::receive_ring::writable(
+  std::span<hal::byte> p_storage)
 {
-  at new_at(p_serial);
+  if (m_capacity == 0) {
+    return p_storage.first(0);
+  }
 
-  HAL_CHECK(new_at.reset(p_timeout));
+  auto write = (m_read + m_count) % m_capacity;
+  // Free space runs to the end of the region or up to the unread data
+  auto length = write < m_read || m_count == m_capacity
+                  ? m_capacity - m_count
+                  : m_capacity - write;
+  return p_storage.subspan(m_offset + write, length);
+}
 
-  return new_at;
+void at::receive_ring::commit(std::size_t p_length)
+{
+  m_count += static_cast<std::uint16_t>(p_length);
 }
 
-hal::status at::reset(deadline p_timeout)
+std::span<hal::byte> at::receive_ring::readable(
+  std::span<hal::byte> p_storage)
 {
-  // Reset the device
-  HAL_CHECK(write(*m_serial, "AT+RST\r\n"));
-  HAL_CHECK(wait_for_reset_complete(m_serial, p_timeout));
+  auto length = std::min<std::size_t>(m_count, m_capacity - m_read);
+  return p_storage.subspan(m_offset + m_read, length);
+}
 
-  // Turn off echo
-  HAL_CHECK(write(*m_serial, "ATE0\r\n"));
-  HAL_CHECK(wait_for_ok(m_serial, p_timeout));
+void at::receive_ring::release(std::size_t p_length)
+{
+  auto length = static_cast<std::uint16_t>(std::min<std::size_t>(
+    p_length, std::min<std::size_t>(m_count, m_capacity - m_read)));
+  if (length == 0) {
+    return;
+  }
 
-  return hal::success();
+  m_read = (m_read + length) % m_capacity;
+  m_count -= length;
+
+  // Restart at the beginning once empty so the next payload is lent out in
+  // one contiguous piece.
+  if (m_count == 0) {
+    m_read = 0;
+  }
 }
 
-// NOLINTNEXTLINE
-hal::status at::connect_to_ap(std::string_view p_ssid,
-                              std::string_view p_password,
-                              deadline p_timeout)
+void at::receive_ring::write(std::span<hal::byte> p_storage,
+                             std::span<const hal::byte> p_data)
+{
+  while (!p_data.empty()) {
+    auto space = writable(p_storage);
+    auto length = std::min(space.size(), p_data.size());
+    if (length == 0) {
+      return;
+    }
+    std::copy_n(p_data.begin(), length, space.begin());
+    commit(length);
+    p_data = p_data.subspan(length);
+  }
+}
+
+std::size_t at::receive_ring::read(std::span<hal::byte> p_storage,
+                                   std::span<hal::byte> p_buffer)
 {
-  // Configure as WiFi Station (client) mode
-  HAL_CHECK(write(*m_serial, "AT+CWMODE=1\r\n"));
-  HAL_CHECK(wait_for_ok(m_serial, p_timeout));
+  std::size_t total = 0;
+  while (total < p_buffer.size()) {
+    auto unread = readable(p_storage);
+    auto length = std::min(unread.size(), p_buffer.size() - total);
+    if (length == 0) {
+      break;
+    }
+    std::copy_n(unread.begin(), length, p_buffer.begin() + total);
+    release(length);
+    total += length;
+  }
+  return total;
+}
 
-  // Connect to wifi access point
-  HAL_CHECK(write(*m_serial, "AT+CWJAP=\""));
-  HAL_CHECK(write(*m_serial, p_ssid));
-  HAL_CHECK(write(*m_serial, "\",\""));
-  HAL_CHECK(write(*m_serial, p_password));
-  HAL_CHECK(write(*m_serial, "\"\r\n"));
-  HAL_CHECK(wait_for_ok(m_serial, p_timeout));
+std::size_t at::receive_ring::peek(std::span<hal::byte> p_storage,
+                                   std::span<hal::byte> p_buffer)
+{
+  auto length = std::min<std::size_t>(m_count, p_buffer.size());
+  for (std::size_t i = 0; i < length; i++) {
+    p_buffer[i] = p_storage[m_offset + (m_read + i) % m_capacity];
+  }
+  return length;
+}
 
-  return hal::success();
+void at::receive_ring::discard(std::size_t p_length)
+{
+  while (p_length != 0 && m_count != 0) {
+    auto length = std::min<std::size_t>(
+      p_length, std::min<std::size_t>(m_count, m_capacity - m_read));
+    release(length);
+    p_length -= length;
+  }
 }
 
-[[nodiscard]] hal::status at::set_ip_address(std::string_view p_ip,
-                                             deadline p_timeout)
+std::size_t at::receive_ring::size()
 {
-  HAL_CHECK(write(*m_serial, "AT+CIPSTA=\""));
-  HAL_CHECK(write(*m_serial, p_ip));
-  HAL_CHECK(write(*m_serial, "\"\r\n"));
-  HAL_CHECK(wait_for_ok(m_serial, p_timeout));
+  return m_count;
+}
 
-  return hal::success();
+std::size_t at::receive_ring::available()
+{
+  return m_capacity - m_count;
 }
 
-hal::result<bool> at::is_connected_to_ap(deadline p_timeout)
+std::size_t at::receive_ring::capacity()
 {
-  // Query the device to determine if it is still connected
-  HAL_CHECK(write(*m_serial, "AT+CWJAP?\r\n"));
+  return m_capacity;
+}
+
+// constructor
+at::at(hal::serial& p_serial, std::span<hal::byte> p_receive_buffer)
+  : m_serial(&p_serial)
+  , m_packet_manager{}
+  // Ring offsets and sizes are 16 bits
+  , m_receive_storage(p_receive_buffer.first(
+      std::min<std::size_t>(p_receive_buffer.size(),
+                            std::numeric_limits<std::uint16_t>::max())))
+  , m_connection_mode(connection_mode::single)
+  , m_receive_mode(receive_mode::active)
+  , m_baud_rate(default_baud_rate)
+  , m_flow_control(flow_control::none)
+  , m_response_state(0)
+  , m_send_window(4)
+  , m_segments_queued(0)
+  , m_segments_acknowledged(0)
+  , m_segments_failed(0)
+  , m_clock(nullptr)
+  , m_dns_ttl(0)
+  , m_connect_clock(nullptr)
+  , m_connect_started(0)
+  , m_connect_time(0)
+  , m_datagram_links(0)
+  , m_discard_packet(false)
+  , m_dropped_datagrams(0)
+  , m_listening(false)
+  , m_accept_queue(0)
+{
+  m_receive[0] =
+    receive_ring(0, static_cast<std::uint16_t>(m_receive_storage.size()));
+  m_link_buffer_sizes.fill(
+    static_cast<std::uint16_t>(m_receive_storage.size() / maximum_links));
+}
+
+hal::status at::receive_packets()
+{
+  while (true) {
+    auto token = scan_tokens();
+    if (!token) {
+      // Only a malformed header is an error, a failed read just means there
+      // is nothing more to receive for now
+      if (!m_packet_manager.is_malformed()) {
+        return hal::success();
+      }
+      m_packet_manager.reset();
+      return token.error();
+    }
+    if (!m_packet_manager.is_complete_header()) {
+      if (token.value() == response::none) {
+        return hal::success();
+      }
+      continue;
+    }
 
-  auto find_confirm = hal::stream_find(hal::as_bytes(ap_connected));
-  auto find_ok = hal::stream_find(hal::as_bytes(ok_response));
+    if (is_datagram_link(m_packet_manager.link())) {
+      if (HAL_CHECK(park_datagram()) == 0) {
+        return hal::success();
+      }
+      continue;
+    }
+
+    auto& ring = m_receive[m_packet_manager.link()];
+    auto space = ring.writable(m_receive_storage);
+    if (space.empty()) {
+      return hal::success();
+    }
+
+    auto payload = HAL_CHECK(m_packet_manager.read_packet(*m_serial, space));
+    if (payload.empty()) {
+      return hal::success();
+    }
+
+    ring.commit(payload.size());
+  }
+}
 
-  while (hal::in_progress(find_confirm) && hal::in_progress(find_ok)) {
-    std::array<hal::byte, 1> buffer;
-    auto read_result = HAL_CHECK(m_serial->read(buffer));
+hal::result<at::response> at::read_response(deadline p_timeout)
+{
+  while (true) {
+    auto token = HAL_CHECK(scan_response());
 
-    // Pipe data into both streams
-    read_result.data | find_confirm;
-    read_result.data | find_ok;
+    if (token != response::none) {
+      return token;
+    }
 
     // Check if we've timed out
     HAL_CHECK(p_timeout());
   }
+}
 
-  // We should fine the confirmation before we find the "OK" response
-  if (hal::finished(find_confirm) && hal::in_progress(find_ok)) {
-    // Read the last of the stream and find the OK to be sure
-    HAL_CHECK(wait_for_ok(m_serial, p_timeout));
-    return true;
-  }
+hal::result<at::response> at::scan_response()
+{
+  while (true) {
+    auto token = scan_tokens();
+    if (!token) {
+      // A malformed header is only reported once
+      if (m_packet_manager.is_malformed()) {
+        m_packet_manager.reset();
+      }
+      return token.error();
+    }
+    if (!m_packet_manager.is_complete_header()) {
+      return token.value();
+    }
 
-  // We should fine the confirmation before we find the "OK" response
-  if (hal::in_progress(find_confirm) && hal::finished(find_ok)) {
-    return false;
+    // Payload can arrive at any time, so it is moved out of the way to keep
+    // the response stream in sync.
+    HAL_CHECK(store_payload());
+    if (m_packet_manager.is_complete_header()) {
+      return response::none;
+    }
   }
-
-  return hal::new_error(std::errc::io_error);
 }
 
-hal::status at::disconnect_from_ap(deadline p_timeout)
+hal::result<at::response> at::scan_tokens()
 {
-  HAL_CHECK(write(*m_serial, "AT+CWQAP\r\n"));
-  HAL_CHECK(wait_for_ok(m_serial, p_timeout));
+  static_assert(response_tokens.size() ==
+                static_cast<size_t>(response::scan_entry));
+
+  while (true) {
+    // A packet header that is still arriving is picked up where the last
+    // scan left off
+    if (m_packet_manager.is_in_fields()) {
+      HAL_CHECK(m_packet_manager.find_fields(*m_serial));
+      // A passive mode notification ends in "\r" rather than ":" and has no
+      // payload. Stop here so the caller can pull the announced data.
+      if (m_packet_manager.is_in_fields() ||
+          m_packet_manager.is_expecting_header()) {
+        return response::none;
+      }
+    }
 
-  return hal::success();
+    // Left in place for the caller to report and reset
+    if (m_packet_manager.is_malformed()) {
+      return hal::new_error(std::errc::io_error);
+    }
+
+    if (m_packet_manager.is_complete_header()) {
+      return response::none;
+    }
+
+    auto window = HAL_CHECK(m_packet_manager.fill(*m_serial));
+    if (window.empty()) {
+      return response::none;
+    }
+
+    // The matcher state is kept so a token split across reads is still found
+    response_matcher matcher(m_response_state);
+    auto match = matcher.scan(window);
+    m_response_state = matcher.state();
+    remember(window.first(match.length));
+    // Only consume up to the end of the token, anything after it belongs to
+    // whoever reads next.
+    m_packet_manager.consume(match.length);
+
+    auto token = static_cast<response>(match.token);
+
+    // Buffered segments are acknowledged in the order they were queued
+    if (token == response::segment_sent) {
+      m_segments_acknowledged++;
+    } else if (token == response::segment_failed) {
+      m_segments_acknowledged++;
+      m_segments_failed++;
+    }
+
+    dispatch_event(token);
+
+    if (token == response::packet) {
+      m_packet_manager.start_fields();
+    } else if (match.token != 0) {
+      return token;
+    }
+  }
 }
 
-hal::status at::connect_to_server(socket_config p_config, deadline p_timeout)
+void at::remember(std::span<const hal::byte> p_bytes)
 {
-  const auto expected_response = hal::as_bytes(ok_response);
+  auto length = std::min(p_bytes.size(), m_history.size());
+  std::shift_left(m_history.begin(), m_history.end(),
+                  static_cast<std::ptrdiff_t>(length));
+  std::copy(p_bytes.end() - static_cast<std::ptrdiff_t>(length),
+            p_bytes.end(),
+            m_history.end() - static_cast<std::ptrdiff_t>(length));
+}
 
-  std::string_view socket_type_str;
+void at::dispatch_event(response p_token)
+{
+  event type;
 
-  switch (p_config.type) {
-    case socket_type::tcp:
-      socket_type_str = "TCP";
+  switch (p_token) {
+    case response::connected:
+    case response::link_connected:
+      type = event::link_connected;
+      break;
+    case response::closed:
+    case response::link_closed:
+      type = event::link_closed;
+      break;
+    case response::wifi_connected:
+      type = event::ap_connected;
       break;
-    case socket_type::udp:
-      socket_type_str = "UDP";
+    case response::wifi_got_ip:
+      type = event::got_ip;
       break;
+    case response::wifi_disconnected:
+      type = event::ap_disconnected;
+      break;
+    default:
+      return;
   }
 
-  auto port_str = HAL_CHECK(integer_string<6>::create(p_config.port));
+  // In multiple connection mode the link id is the digit in front of the
+  // notice:
+  //
+  //  <link>,CLOSED\r\n
+  std::uint8_t link_id = 0;
+  if (p_token == response::link_connected ||
+      p_token == response::link_closed) {
+    auto length = response_tokens[static_cast<size_t>(p_token) - 1].size();
+    auto digit = m_history[m_history.size() - length - 1];
+    if (digit >= '0' && digit < '0' + maximum_links) {
+      link_id = static_cast<std::uint8_t>(digit - '0');
+    }
+  }
 
-  // Connect to web server
-  HAL_CHECK(hal::write(*m_serial, "AT+CIPSTART=\""));
-  HAL_CHECK(hal::write(*m_serial, socket_type_str));
-  HAL_CHECK(hal::write(*m_serial, "\",\""));
-  HAL_CHECK(hal::write(*m_serial, p_config.domain));
-  HAL_CHECK(hal::write(*m_serial, "\","));
-  HAL_CHECK(hal::write(*m_serial, port_str.str()));
-  HAL_CHECK(hal::write(*m_serial, "\r\n"));
-  HAL_CHECK(hal::try_until(skip_past(*m_serial, expected_response), p_timeout));
+  // A CONNECT for a link the driver isn't opening itself is a client of the
+  // server
+  auto link_bit = static_cast<std::uint8_t>(1U << link_id);
+  bool opening = is_busy() &&
+                 m_operation.kind == operation_kind::link_connect &&
+                 m_operation.link == link_id;
+  if (p_token == response::link_connected && m_listening && !opening) {
+    m_accept_queue |= link_bit;
+    m_datagram_links &= static_cast<std::uint8_t>(~link_bit);
+  } else if (p_token == response::link_closed) {
+    m_accept_queue &= static_cast<std::uint8_t>(~link_bit);
+  }
 
-  return hal::success();
+  if (m_event_handler) {
+    m_event_handler(type, link_id);
+  }
 }
 
-hal::result<at::write_t> at::server_write(std::span<const hal::byte> p_data,
-                                          deadline p_timeout)
+hal::status at::store_payload()
 {
-  using namespace std::literals;
-
-  if (p_data.size() > maximum_transmit_packet_size) {
-    return new_error(std::errc::file_too_large);
+  if (is_datagram_link(m_packet_manager.link())) {
+    while (m_packet_manager.is_complete_header()) {
+      if (HAL_CHECK(park_datagram()) == 0) {
+        break;
+      }
+    }
+    // The datagram waits in the UART until its link is read
+    if (m_packet_manager.is_new_packet()) {
+      return hal::new_error(std::errc::no_buffer_space);
+    }
+    return hal::success();
   }
 
-  auto write_length = HAL_CHECK(integer_string<10>::create(p_data.size()));
-  HAL_CHECK(hal::write(*m_serial, "AT+CIPSEND="));
-  HAL_CHECK(hal::write(*m_serial, write_length.str()));
-  HAL_CHECK(hal::write(*m_serial, "\r\n"));
-  HAL_CHECK(try_until(skip_past(*m_serial, hal::as_bytes(">"sv)), p_timeout));
-  HAL_CHECK(hal::write(*m_serial, p_data));
-
-  auto find_packet = hal::stream_find(hal::as_bytes(start_of_packet));
-  auto find_send_finish = hal::stream_find(hal::as_bytes(send_finished));
+  auto& ring = m_receive[m_packet_manager.link()];
 
-  while (hal::in_progress(find_packet) && hal::in_progress(find_send_finish)) {
-    std::array<hal::byte, 1> buffer;
-    auto read_result = HAL_CHECK(m_serial->read(buffer));
+  while (m_packet_manager.is_complete_header()) {
+    auto space = ring.writable(m_receive_storage);
 
-    // Pipe data into both streams
-    read_result.data | find_packet;
-    read_result.data | find_send_finish;
+    // Nowhere to keep the rest of this packet. It stays in the UART until
+    // the link is read, so the responses behind it can't be reached yet.
+    if (space.empty()) {
+      return hal::new_error(std::errc::no_buffer_space);
+    }
 
-    // Check if we've timed out
-    HAL_CHECK(p_timeout());
-  }
+    auto length =
+      HAL_CHECK(m_packet_manager.read_packet(*m_serial, space)).size();
+    ring.commit(length);
 
-  // If we found the start of a packet, we need to set the state of the packet
-  // manager to expect the first digit.
-  if (hal::finished(find_packet)) {
-    m_packet_manager.set_state(packet_manager_state::expect_digit1);
+    // The rest of the payload hasn't arrived yet
+    if (length == 0) {
+      break;
+    }
   }
 
-  return write_t{ .data = p_data };
+  return hal::success();
 }
 
-hal::result<bool> at::is_connected_to_server(deadline p_timeout)
+hal::status at::read_exact(std::span<hal::byte> p_buffer, deadline p_timeout)
 {
-  constexpr std::string_view response_status = "STATUS";
-  constexpr std::string_view response_start = "+CIPSTATUS:";
-
-  // Query the device to determine if it is still connected
-  HAL_CHECK(write(*m_serial, "AT+CIPSTATUS\r\n"));
+  while (!p_buffer.empty()) {
+    auto window = HAL_CHECK(m_packet_manager.fill(*m_serial));
+    auto length = std::min(window.size(), p_buffer.size());
+    std::copy_n(window.begin(), length, p_buffer.begin());
+    m_packet_manager.consume(length);
+    p_buffer = p_buffer.subspan(length);
+
+    if (!p_buffer.empty()) {
+      HAL_CHECK(p_timeout());
+    }
+  }
 
-  auto find_status = hal::stream_find(hal::as_bytes(response_status));
-  auto find_start = hal::stream_find(hal::as_bytes(response_start));
-  auto find_ok = hal::stream_find(hal::as_bytes(ok_response));
+  return hal::success();
+}
 
-  while (hal::in_progress(find_start) && hal::in_progress(find_ok)) {
-    std::array<hal::byte, 1> buffer;
-    auto read_result = HAL_CHECK(m_serial->read(buffer));
+hal::result<std::uint32_t> at::read_integer(deadline p_timeout)
+{
+  std::uint32_t value = 0;
 
-    // Pipe data into both streams
-    read_result.data | find_status | find_start;
-    read_result.data | find_ok;
+  while (true) {
+    if (HAL_CHECK(scan_integer(value))) {
+      return value;
+    }
 
     // Check if we've timed out
     HAL_CHECK(p_timeout());
   }
+}
 
-  // We should fine the confirmation before we find the "OK" response
-  if (hal::finished(find_start) && hal::in_progress(find_ok)) {
-    // Read the last of the stream and find the OK to be sure
-    HAL_CHECK(wait_for_ok(m_serial, p_timeout));
-    return true;
-  }
+hal::result<bool> at::scan_integer(std::uint32_t& p_value)
+{
+  while (true) {
+    auto window = HAL_CHECK(m_packet_manager.fill(*m_serial));
+    if (window.empty()) {
+      return false;
+    }
 
-  // We should find the confirmation before we find the "OK" response
-  if (hal::in_progress(find_start) && hal::finished(find_ok)) {
-    return false;
-  }
+    size_t digits = 0;
+    for (auto byte : window) {
+      if (!is_digit(byte)) {
+        // Leave the terminator for whoever reads next
+        m_packet_manager.consume(digits);
+        return true;
+      }
+      p_value = p_value * 10 + (byte - '0');
+      digits++;
+    }
 
-  return hal::new_error(std::errc::io_error);
+    m_packet_manager.consume(digits);
+  }
 }
 
-hal::result<at::read_t> at::server_read(std::span<hal::byte> p_buffer)
+hal::status at::wait_for(response p_response, deadline p_timeout)
 {
-  // Format of a TCP packet for the ESP8266 AT commands:
-  //
-  //  +IDP,[0-9]+:[.*]{1460}
-  //
-  // Example:
-  //
-  //  +IDP,1230:
-  //
-  // Starts with a header, then length, then a ':' character, then 1 to 1460
-  // bytes worth of payload data.
+  while (true) {
+    auto token = HAL_CHECK(read_response(p_timeout));
 
-  size_t bytes_read = 0;
-  auto buffer = p_buffer;
-  auto read = std::span<hal::byte>();
-
-  do {
-    m_packet_manager.find(*m_serial);
-    read = HAL_CHECK(m_packet_manager.read_packet(*m_serial, buffer));
-    bytes_read += read.size();
-    buffer = buffer.subspan(read.size());
-  } while (read.size() != 0 && buffer.size() != 0);
+    if (token == p_response) {
+      return hal::success();
+    }
+
+    switch (token) {
+      case response::error:
+      case response::fail:
+      case response::send_fail:
+        return hal::new_error(std::errc::io_error);
+      case response::busy:
+        // The module dropped the command without running it
+        return hal::new_error(std::errc::device_or_resource_busy);
+      default:
+        break;
+    }
+  }
+}
+
+hal::status at::run_commands(std::span<const std::string_view> p_commands,
+                             std::span<command_status> p_status,
+                             deadline p_timeout)
+{
+  if (p_status.size() < p_commands.size()) {
+    return hal::new_error(std::errc::invalid_argument);
+  }
+
+  // Checked up front so that nothing is sent if any command is too long
+  for (auto command : p_commands) {
+    if (command.size() > command_max_length) {
+      return hal::new_error(std::errc::invalid_argument);
+    }
+  }
+
+  auto status = p_status.first(p_commands.size());
+  std::fill(status.begin(), status.end(), command_status::busy);
+
+  while (true) {
+    // Send everything that hasn't been accepted yet back to back
+    for (std::size_t i = 0; i < p_commands.size(); i++) {
+      if (status[i] == command_status::busy) {
+        command_builder<command_length(command_max_length, "\r\n")> command;
+        command.append(p_commands[i]).append("\r\n");
+        HAL_CHECK(command.write(*m_serial));
+        status[i] = command_status::pending;
+      }
+    }
+
+    // The module runs commands one at a time, so each OK or ERROR belongs to
+    // the oldest pending command. A busy reply is sent for a command that
+    // arrived while an earlier one was still running, and it is dropped.
+    while (true) {
+      auto running = std::find(status.begin(), status.end(),
+                               command_status::pending);
+      if (running == status.end()) {
+        break;
+      }
+
+      auto token = HAL_CHECK(read_response(p_timeout));
+
+      switch (token) {
+        case response::ok:
+          *running = command_status::ok;
+          break;
+        case response::error:
+        case response::fail:
+          *running = command_status::error;
+          break;
+        case response::busy: {
+          auto dropped =
+            std::find(running + 1, status.end(), command_status::pending);
+          // With nothing queued behind it, the module was busy with something
+          // that started before these commands.
+          if (dropped == status.end()) {
+            dropped = running;
+          }
+          *dropped = command_status::busy;
+          break;
+        }
+        default:
+          break;
+      }
+    }
+
+    if (std::find(status.begin(), status.end(), command_status::busy) ==
+        status.end()) {
+      break;
+    }
+
+    HAL_CHECK(p_timeout());
+  }
+
+  if (std::find(status.begin(), status.end(), command_status::error) !=
+      status.end()) {
+    return hal::new_error(std::errc::io_error);
+  }
+
+  return hal::success();
+}
+
+result<at> at::create(hal::serial& p_serial,
+                      std::span<hal::byte> p_receive_buffer,
+                      deadline p_timeout)
+{
+  at new_at(p_serial, p_receive_buffer);
+
+  HAL_CHECK(new_at.reset(p_timeout));
+
+  return new_at;
+}
+
+result<at> at::warm_start(hal::serial& p_serial,
+                          std::span<hal::byte> p_receive_buffer,
+                          deadline p_probe_timeout,
+                          deadline p_timeout)
+{
+  at new_at(p_serial, p_receive_buffer);
+
+  if (!new_at.resume_session(p_probe_timeout)) {
+    // A stray OK left over from the probe would be taken as the answer to
+    // AT+RST, so everything received so far is dropped first
+    HAL_CHECK(new_at.m_serial->flush());
+    new_at.m_packet_manager.discard();
+    new_at.m_response_state = 0;
+    HAL_CHECK(new_at.reset(p_timeout));
+  }
+
+  return new_at;
+}
+
+hal::status at::resume_session(deadline p_timeout)
+{
+  // Turning off echo doubles as the probe, the OK is found whether or not
+  // the command is echoed back first
+  HAL_CHECK(write(*m_serial, "ATE0\r\n"));
+  HAL_CHECK(wait_for(response::ok, p_timeout));
+
+  // Carry on with the settings the previous session left behind
+  HAL_CHECK(write(*m_serial, "AT+CIPMUX?\r\n"));
+  HAL_CHECK(wait_for(response::mux_status, p_timeout));
+  auto multiplexed = HAL_CHECK(read_integer(p_timeout)) != 0;
+  HAL_CHECK(wait_for(response::ok, p_timeout));
+
+  HAL_CHECK(write(*m_serial, "AT+CIPRECVMODE?\r\n"));
+  HAL_CHECK(wait_for(response::receive_mode_status, p_timeout));
+  auto passive = HAL_CHECK(read_integer(p_timeout)) != 0;
+  HAL_CHECK(wait_for(response::ok, p_timeout));
+
+  // Links that are already open as UDP keep their datagrams whole. Each
+  // open link is reported on its own line:
+  //
+  //  +CIPSTATUS:<link>,"<type>",<remote ip>,<remote port>,<local port>,...
+  HAL_CHECK(write(*m_serial, "AT+CIPSTATUS\r\n"));
+  std::uint8_t datagram_links = 0;
+  while (true) {
+    auto token = HAL_CHECK(read_response(p_timeout));
+    if (token == response::ok) {
+      break;
+    }
+    if (token == response::error || token == response::fail) {
+      return hal::new_error(std::errc::io_error);
+    }
+    if (token != response::server_status) {
+      continue;
+    }
+
+    auto id = HAL_CHECK(read_integer(p_timeout));
+    std::array<hal::byte, 5> type;  // ,"UDP
+    HAL_CHECK(read_exact(type, p_timeout));
+    auto type_name = std::string_view(
+      reinterpret_cast<const char*>(type.data()), type.size());
+    if (id < maximum_links && type_name == ",\"UDP") {
+      datagram_links |= static_cast<std::uint8_t>(1U << id);
+    }
+  }
+
+  use_connection_mode(multiplexed ? connection_mode::multiple
+                                  : connection_mode::single);
+  m_receive_mode = passive ? receive_mode::passive : receive_mode::active;
+  m_datagram_links = datagram_links;
+
+  return hal::success();
+}
+
+hal::status at::reset(deadline p_timeout)
+{
+  return finish_operation(HAL_CHECK(start_reset()), p_timeout);
+}
+
+hal::status at::set_baud_rate(std::uint32_t p_baud_rate,
+                              deadline p_timeout,
+                              deadline p_fallback_timeout)
+{
+  auto previous_baud_rate = m_baud_rate;
+
+  // The module acknowledges at the old rate before it switches
+  HAL_CHECK(write_uart_config(p_baud_rate));
+  HAL_CHECK(wait_for(response::ok, p_timeout));
+
+  auto switched = switch_baud_rate(p_baud_rate, p_timeout);
+  if (switched) {
+    return hal::success();
+  }
+
+  // The module is most likely at the new rate even if the host could not
+  // hear it, so ask it to go back before listening at the old rate again.
+  // Neither of these is expected to get a clean answer.
+  (void)write_uart_config(previous_baud_rate);
+  (void)wait_for(response::ok, p_fallback_timeout);
+  HAL_CHECK(switch_baud_rate(previous_baud_rate, p_fallback_timeout));
+
+  return switched;
+}
+
+std::uint32_t at::baud_rate() const
+{
+  return m_baud_rate;
+}
+
+hal::status at::set_flow_control(flow_control p_flow_control,
+                                 deadline p_timeout)
+{
+  auto previous_flow_control = m_flow_control;
+  m_flow_control = p_flow_control;
+
+  auto sent = write_uart_config(m_baud_rate);
+  if (sent) {
+    sent = wait_for(response::ok, p_timeout);
+  }
+
+  if (!sent) {
+    m_flow_control = previous_flow_control;
+  }
+
+  return sent;
+}
+
+void at::set_serial_settings(const hal::serial::settings& p_settings)
+{
+  m_serial_settings = p_settings;
+}
+
+void at::set_lossless(bool p_lossless)
+{
+  m_packet_manager.set_lossless(p_lossless);
+}
+
+void at::on_event(hal::callback<event_handler> p_handler)
+{
+  m_event_handler = std::move(p_handler);
+}
+
+hal::status at::poll_events()
+{
+  // The responses an operation is waiting for would be consumed here
+  if (is_busy()) {
+    return hal::new_error(std::errc::device_or_resource_busy);
+  }
+
+  while (HAL_CHECK(scan_response()) != response::none) {
+    continue;
+  }
+
+  return hal::success();
+}
+
+// NOLINTNEXTLINE
+hal::status at::connect_to_ap(std::string_view p_ssid,
+                              std::string_view p_password,
+                              deadline p_timeout)
+{
+  return connect_to_ap(p_ssid, p_password, "", p_timeout);
+}
+
+// NOLINTNEXTLINE
+hal::status at::connect_to_ap(std::string_view p_ssid,
+                              std::string_view p_password,
+                              std::string_view p_bssid,
+                              deadline p_timeout)
+{
+  return finish_operation(
+    HAL_CHECK(start_connect_to_ap(p_ssid, p_password, p_bssid)), p_timeout);
+}
+
+hal::status at::set_network_config(const network_config& p_config,
+                                   deadline p_timeout)
+{
+  if (p_config.ip.empty() ||
+      p_config.gateway.empty() != p_config.netmask.empty() ||
+      (p_config.primary_dns.empty() && !p_config.secondary_dns.empty())) {
+    return hal::new_error(std::errc::invalid_argument);
+  }
+
+  //  AT+CIPSTA_CUR=<ip>[,<gateway>,<netmask>]
+  command_builder<command_length("AT+CIPSTA_CUR=\"",
+                                 ip_max_length,
+                                 "\",\"",
+                                 ip_max_length,
+                                 "\",\"",
+                                 ip_max_length,
+                                 "\"")>
+    address;
+  address.append("AT+CIPSTA_CUR=").append_quoted(p_config.ip);
+  if (!p_config.gateway.empty()) {
+    address.append(",")
+      .append_quoted(p_config.gateway)
+      .append(",")
+      .append_quoted(p_config.netmask);
+  }
+
+  //  AT+CIPDNS_CUR=1,<dns>[,<dns>]
+  command_builder<command_length(
+    "AT+CIPDNS_CUR=1,\"", ip_max_length, "\",\"", ip_max_length, "\"")>
+    dns;
+  dns.append("AT+CIPDNS_CUR=1,").append_quoted(p_config.primary_dns);
+  if (!p_config.secondary_dns.empty()) {
+    dns.append(",").append_quoted(p_config.secondary_dns);
+  }
+
+  std::array commands{
+    std::string_view("AT+CWDHCP_CUR=1,0"),
+    HAL_CHECK(address.str()),
+    HAL_CHECK(dns.str()),
+  };
+  std::array<command_status, commands.size()> status;
+  auto count = p_config.primary_dns.empty() ? 2 : commands.size();
+
+  return run_commands(std::span(commands).first(count), status, p_timeout);
+}
+
+hal::status at::set_dhcp(bool p_enabled, deadline p_timeout)
+{
+  // Mode 1 is the station
+  auto command = p_enabled ? "AT+CWDHCP_CUR=1,1\r\n" : "AT+CWDHCP_CUR=1,0\r\n";
+  HAL_CHECK(write(*m_serial, command));
+  return wait_for(response::ok, p_timeout);
+}
+
+hal::result<at::access_point> at::connected_access_point(deadline p_timeout)
+{
+  static_assert(sizeof(access_point::bssid) == bssid_length);
+
+  if (is_busy()) {
+    return hal::new_error(std::errc::device_or_resource_busy);
+  }
+
+  HAL_CHECK(write(*m_serial, "AT+CWJAP?\r\n"));
+
+  // Without an access point the module answers "No AP" and OK
+  while (true) {
+    auto token = HAL_CHECK(read_response(p_timeout));
+    if (token == response::ap_connected) {
+      break;
+    }
+    if (token == response::ok) {
+      return hal::new_error(std::errc::not_connected);
+    }
+    if (token == response::error || token == response::busy) {
+      return hal::new_error(std::errc::io_error);
+    }
+  }
+
+  // +CWJAP:"<ssid>","<bssid>",<channel>,<rssi>
+  //
+  // The SSID is not escaped, so the BSSID is found by the "," that follows
+  // the SSID's closing quote.
+  std::array<hal::byte, 3> recent{};
+  constexpr std::array<hal::byte, 3> separator{ '"', ',', '"' };
+  while (recent != separator) {
+    std::array<hal::byte, 1> character;
+    HAL_CHECK(read_exact(character, p_timeout));
+    std::shift_left(recent.begin(), recent.end(), 1);
+    recent.back() = character[0];
+  }
+
+  access_point info;
+  std::array<hal::byte, bssid_length> bssid;
+  HAL_CHECK(read_exact(bssid, p_timeout));
+  std::copy(bssid.begin(), bssid.end(), info.bssid.begin());
+
+  std::array<hal::byte, 2> quote_and_comma;
+  HAL_CHECK(read_exact(quote_and_comma, p_timeout));
+  info.channel = static_cast<std::uint8_t>(HAL_CHECK(read_integer(p_timeout)));
+
+  // The signal strength is in dBm, which is always negative
+  std::array<hal::byte, 2> comma_and_sign;
+  HAL_CHECK(read_exact(comma_and_sign, p_timeout));
+  if (comma_and_sign[1] != '-') {
+    return hal::new_error(std::errc::io_error);
+  }
+  auto rssi = HAL_CHECK(read_integer(p_timeout));
+  info.rssi = static_cast<std::int8_t>(-static_cast<int>(rssi));
+
+  HAL_CHECK(wait_for(response::ok, p_timeout));
+  return info;
+}
+
+hal::status at::scan_each(hal::function_ref<scan_handler> p_handler,
+                          deadline p_timeout)
+{
+  static_assert(sizeof(scan_result::ssid) == ssid_max_length);
+  static_assert(sizeof(scan_result::bssid) == bssid_length);
+
+  if (is_busy()) {
+    return hal::new_error(std::errc::device_or_resource_busy);
+  }
+
+  // Sort by signal strength and list only the SSID (2), RSSI (4), BSSID (8)
+  // and channel (16)
+  HAL_CHECK(write(*m_serial, "AT+CWLAPOPT=1,30\r\n"));
+  HAL_CHECK(wait_for(response::ok, p_timeout));
+  HAL_CHECK(write(*m_serial, "AT+CWLAP\r\n"));
+
+  while (true) {
+    auto token = HAL_CHECK(read_response(p_timeout));
+    if (token == response::ok) {
+      return hal::success();
+    }
+    if (token == response::error || token == response::fail ||
+        token == response::busy) {
+      return hal::new_error(std::errc::io_error);
+    }
+    if (token != response::scan_entry) {
+      continue;
+    }
+
+    // +CWLAP:("<ssid>",<rssi>,"<bssid>",<channel>)
+    //
+    // The SSID is not escaped, but the signal strength after it is always
+    // negative, so the SSID ends at the first "," followed by a '-'.
+    scan_result entry;
+    std::array<hal::byte, 2> open;
+    HAL_CHECK(read_exact(open, p_timeout));
+
+    constexpr std::array<hal::byte, 3> end_of_ssid{ '"', ',', '-' };
+    std::array<hal::byte, ssid_max_length + end_of_ssid.size()> field;
+    std::size_t length = 0;
+    while (length < end_of_ssid.size() ||
+           !std::equal(end_of_ssid.begin(),
+                       end_of_ssid.end(),
+                       field.begin() + length - end_of_ssid.size())) {
+      if (length == field.size()) {
+        return hal::new_error(std::errc::io_error);
+      }
+      HAL_CHECK(read_exact(std::span(field).subspan(length, 1), p_timeout));
+      length++;
+    }
+    length -= end_of_ssid.size();
+    std::copy_n(field.begin(), length, entry.ssid.begin());
+    entry.ssid_length = static_cast<std::uint8_t>(length);
+
+    auto rssi = HAL_CHECK(read_integer(p_timeout));
+    entry.rssi = static_cast<std::int8_t>(-static_cast<int>(rssi));
+
+    std::array<hal::byte, 2> comma_and_quote;
+    HAL_CHECK(read_exact(comma_and_quote, p_timeout));
+    std::array<hal::byte, bssid_length> bssid;
+    HAL_CHECK(read_exact(bssid, p_timeout));
+    std::copy(bssid.begin(), bssid.end(), entry.bssid.begin());
+
+    std::array<hal::byte, 2> quote_and_comma;
+    HAL_CHECK(read_exact(quote_and_comma, p_timeout));
+    auto channel = HAL_CHECK(read_integer(p_timeout));
+    entry.channel = static_cast<std::uint8_t>(channel);
+
+    p_handler(entry);
+  }
+}
+
+hal::result<std::span<at::scan_result>> at::scan(
+  std::span<scan_result> p_results,
+  deadline p_timeout)
+{
+  // Entries arrive strongest first, so the ones that don't fit are the
+  // weakest
+  std::size_t count = 0;
+  HAL_CHECK(scan_each(
+    [&p_results, &count](const scan_result& p_result) {
+      if (count < p_results.size()) {
+        p_results[count++] = p_result;
+      }
+    },
+    p_timeout));
+  return p_results.first(count);
+}
+
+hal::status at::set_ip_address(std::string_view p_ip, deadline p_timeout)
+{
+  return finish_operation(HAL_CHECK(start_set_ip_address(p_ip)), p_timeout);
+}
+
+hal::result<bool> at::is_connected_to_ap(deadline p_timeout)
+{
+  auto pending = HAL_CHECK(start_is_connected_to_ap());
+  HAL_CHECK(finish_operation(pending, p_timeout));
+  return pending.result();
+}
+
+hal::status at::disconnect_from_ap(deadline p_timeout)
+{
+  return finish_operation(HAL_CHECK(start_disconnect_from_ap()), p_timeout);
+}
+
+void at::enable_dns_cache(hal::steady_clock& p_clock,
+                          hal::time_duration p_ttl)
+{
+  m_clock = &p_clock;
+  m_dns_ttl = p_ttl;
+}
+
+void at::measure_connect_time(hal::steady_clock& p_clock)
+{
+  m_connect_clock = &p_clock;
+}
+
+hal::time_duration at::last_connect_time() const
+{
+  return m_connect_time;
+}
+
+hal::status at::set_ssl_auth(ssl_auth p_auth, deadline p_timeout)
+{
+  return link_set_ssl_auth(0, p_auth, p_timeout);
+}
+
+hal::status at::set_ssl_buffer_size(std::uint16_t p_size, deadline p_timeout)
+{
+  if (p_size < 2048 || p_size > 4096) {
+    return hal::new_error(std::errc::invalid_argument);
+  }
+
+  command_builder<command_length(
+    "AT+CIPSSLSIZE=", integer_digits<std::uint16_t>(), "\r\n")>
+    command;
+  command.append("AT+CIPSSLSIZE=").append(p_size).append("\r\n");
+  HAL_CHECK(command.write(*m_serial));
+  return wait_for(response::ok, p_timeout);
+}
+
+hal::result<std::string_view> at::resolve(std::string_view p_domain,
+                                          deadline p_timeout)
+{
+  static_assert(sizeof(dns_entry::domain) == domain_max_length);
+  static_assert(sizeof(dns_entry::address) == ip_max_length);
+
+  if (is_busy()) {
+    return hal::new_error(std::errc::device_or_resource_busy);
+  }
+
+  if (p_domain.empty() || p_domain.size() > domain_max_length) {
+    return hal::new_error(std::errc::invalid_argument);
+  }
+
+  if (auto* entry = find_dns_entry(p_domain)) {
+    return std::string_view(entry->address.data(), entry->address_length);
+  }
+
+  command_builder<command_length(
+    "AT+CIPDOMAIN=\"", domain_max_length, "\"\r\n")>
+    command;
+  command.append("AT+CIPDOMAIN=").append_quoted(p_domain).append("\r\n");
+  HAL_CHECK(command.write(*m_serial));
+
+  // Newer firmware quotes the address:
+  //
+  //  +CIPDOMAIN:<ip>\r\n
+  //  +CIPDOMAIN:"<ip>"\r\n
+  HAL_CHECK(wait_for(response::domain_address, p_timeout));
+  std::array<char, ip_max_length> address{};
+  std::size_t address_length = 0;
+  while (true) {
+    std::array<hal::byte, 1> character;
+    HAL_CHECK(read_exact(character, p_timeout));
+    if (character[0] == '\r') {
+      break;
+    }
+    if (character[0] == '"') {
+      continue;
+    }
+    if (address_length == address.size()) {
+      return hal::new_error(std::errc::io_error);
+    }
+    address[address_length++] = static_cast<char>(character[0]);
+  }
+  HAL_CHECK(wait_for(response::ok, p_timeout));
+
+  // Replace the entry closest to expiring, which is an unused one if any
+  auto* entry = std::min_element(
+    m_dns_cache.begin(),
+    m_dns_cache.end(),
+    [](const dns_entry& p_left, const dns_entry& p_right) {
+      return p_left.expires < p_right.expires;
+    });
+
+  std::copy(p_domain.begin(), p_domain.end(), entry->domain.begin());
+  entry->domain_length = static_cast<std::uint8_t>(p_domain.size());
+  std::copy_n(address.begin(), address_length, entry->address.begin());
+  entry->address_length = static_cast<std::uint8_t>(address_length);
+  entry->expires =
+    m_clock != nullptr ? hal::future_deadline(*m_clock, m_dns_ttl) : 0;
+
+  return std::string_view(entry->address.data(), entry->address_length);
+}
+
+at::dns_entry* at::find_dns_entry(std::string_view p_domain)
+{
+  if (m_clock == nullptr) {
+    return nullptr;
+  }
+
+  auto now = m_clock->uptime().ticks;
+  for (auto& entry : m_dns_cache) {
+    auto domain = std::string_view(entry.domain.data(), entry.domain_length);
+    if (domain == p_domain && now < entry.expires) {
+      return &entry;
+    }
+  }
+
+  return nullptr;
+}
+
+void at::forget_address(std::string_view p_domain)
+{
+  for (auto& entry : m_dns_cache) {
+    auto domain = std::string_view(entry.domain.data(), entry.domain_length);
+    if (domain == p_domain) {
+      entry = dns_entry{};
+    }
+  }
+}
+
+hal::status at::connect_to_server(socket_config p_config, deadline p_timeout)
+{
+  return link_connect(0, p_config, p_timeout);
+}
+
+hal::result<at::write_t> at::server_write(std::span<const hal::byte> p_data,
+                                          deadline p_timeout)
+{
+  return link_write(0, p_data, p_timeout);
+}
+
+hal::result<std::uint32_t> at::server_write_buffered(
+  std::span<const hal::byte> p_data,
+  deadline p_timeout)
+{
+  if (m_connection_mode != connection_mode::single) {
+    return hal::new_error(std::errc::operation_not_supported);
+  }
+
+  while (!p_data.empty()) {
+    auto segment =
+      p_data.first(std::min(p_data.size(), maximum_transmit_packet_size));
+
+    // Let the oldest segments drain before queuing more
+    while (m_segments_queued - m_segments_acknowledged >= m_send_window) {
+      HAL_CHECK(read_response(p_timeout));
+    }
+
+    command_builder<command_length(
+      "AT+CIPSENDBUF=", integer_digits<std::uint16_t>(), "\r\n")>
+      command;
+    command.append("AT+CIPSENDBUF=")
+      .append(static_cast<std::uint16_t>(segment.size()))
+      .append("\r\n");
+    HAL_CHECK(command.write(*m_serial));
+    HAL_CHECK(wait_for(response::prompt, p_timeout));
+
+    // "Recv <length> bytes" means the module has the data and can take the
+    // next command, "<segment>,SEND OK" follows once it has been sent.
+    HAL_CHECK(write(*m_serial, segment));
+    HAL_CHECK(wait_for(response::segment_received, p_timeout));
+
+    m_segments_queued++;
+    p_data = p_data.subspan(segment.size());
+  }
+
+  return m_segments_queued;
+}
+
+hal::status at::wait_for_segments(std::uint32_t p_segment,
+                                  deadline p_timeout)
+{
+  while (m_segments_acknowledged < p_segment) {
+    HAL_CHECK(read_response(p_timeout));
+  }
+
+  if (m_segments_failed != 0) {
+    return hal::new_error(std::errc::io_error);
+  }
+
+  return hal::success();
+}
+
+void at::set_send_window(std::uint8_t p_segments)
+{
+  m_send_window = std::max<std::uint8_t>(p_segments, 1);
+}
+
+std::uint32_t at::acknowledged_segments() const
+{
+  return m_segments_acknowledged;
+}
+
+std::uint32_t at::failed_segments() const
+{
+  return m_segments_failed;
+}
+
+hal::result<bool> at::is_connected_to_server(deadline p_timeout)
+{
+  return link_is_connected(0, p_timeout);
+}
+
+hal::result<at::read_t> at::server_read(std::span<hal::byte> p_buffer)
+{
+  return link_read(0, p_buffer);
+}
+
+hal::result<at::read_t> at::server_read(std::span<hal::byte> p_buffer,
+                                        deadline p_timeout)
+{
+  return link_read(0, p_buffer, p_timeout);
+}
+
+hal::result<std::span<const hal::byte>> at::acquire_read()
+{
+  return link_acquire_read(0);
+}
+
+hal::result<at::write_t> at::send_to(std::span<const hal::byte> p_data,
+                                     std::string_view p_address,
+                                     std::uint16_t p_port,
+                                     deadline p_timeout)
+{
+  return link_send_to(0, p_data, p_address, p_port, p_timeout);
+}
+
+hal::result<at::datagram> at::receive_from(std::span<hal::byte> p_buffer,
+                                           deadline p_timeout)
+{
+  return link_receive_from(0, p_buffer, p_timeout);
+}
+
+hal::status at::set_remote_info(bool p_enabled, deadline p_timeout)
+{
+  auto command = p_enabled ? "AT+CIPDINFO=1\r\n" : "AT+CIPDINFO=0\r\n";
+  HAL_CHECK(write(*m_serial, command));
+  return wait_for(response::ok, p_timeout);
+}
+
+void at::release_read(std::size_t p_length)
+{
+  link_release_read(0, p_length);
+}
+
+hal::status at::disconnect_from_server(deadline p_timeout)
+{
+  return link_disconnect(0, p_timeout);
+}
+
+hal::status at::set_connection_mode(connection_mode p_mode,
+                                    deadline p_timeout)
+{
+  bool multiplexed = p_mode == connection_mode::multiple;
+
+  HAL_CHECK(
+    write(*m_serial, multiplexed ? "AT+CIPMUX=1\r\n" : "AT+CIPMUX=0\r\n"));
+  HAL_CHECK(wait_for(response::ok, p_timeout));
+
+  use_connection_mode(p_mode);
+
+  return hal::success();
+}
+
+hal::status at::set_link_buffer_sizes(
+  std::array<std::uint16_t, maximum_links> p_sizes)
+{
+  std::size_t total = 0;
+  for (auto size : p_sizes) {
+    total += size;
+  }
+  if (total > m_receive_storage.size()) {
+    return hal::new_error(std::errc::invalid_argument);
+  }
+
+  m_link_buffer_sizes = p_sizes;
+  if (m_connection_mode == connection_mode::multiple) {
+    use_connection_mode(connection_mode::multiple);
+  }
+
+  return hal::success();
+}
+
+void at::use_connection_mode(connection_mode p_mode)
+{
+  bool multiplexed = p_mode == connection_mode::multiple;
+
+  m_connection_mode = p_mode;
+  m_packet_manager.set_multiplexed(multiplexed);
+
+  // The one link in single connection mode gets the whole receive buffer,
+  // otherwise each link gets its share one after the other
+  auto total = static_cast<std::uint16_t>(m_receive_storage.size());
+  std::uint16_t offset = 0;
+  for (std::uint8_t id = 0; id < maximum_links; id++) {
+    if (multiplexed) {
+      m_receive[id] = receive_ring(offset, m_link_buffer_sizes[id]);
+      offset = static_cast<std::uint16_t>(offset + m_link_buffer_sizes[id]);
+    } else {
+      m_receive[id] = receive_ring(0, id == 0 ? total : 0);
+    }
+  }
+}
+
+void at::forget_session()
+{
+  // The module restarts in single connection, active receive mode with no
+  // connections and no server
+  use_connection_mode(connection_mode::single);
+  for (std::uint8_t id = 0; id < maximum_links; id++) {
+    m_packet_manager.set_pending(id, 0);
+  }
+  m_receive_mode = receive_mode::active;
+  m_listening = false;
+  m_accept_queue = 0;
+  m_datagram_links = 0;
+  m_discard_packet = false;
+  m_dropped_datagrams = 0;
+  m_segments_queued = 0;
+  m_segments_acknowledged = 0;
+  m_segments_failed = 0;
+}
+
+hal::status at::set_receive_mode(receive_mode p_mode, deadline p_timeout)
+{
+  bool passive = p_mode == receive_mode::passive;
+
+  HAL_CHECK(write(*m_serial,
+                  passive ? "AT+CIPRECVMODE=1\r\n" : "AT+CIPRECVMODE=0\r\n"));
+  HAL_CHECK(wait_for(response::ok, p_timeout));
+
+  m_receive_mode = p_mode;
+
+  return hal::success();
+}
+
+hal::result<at::transparent_stream> at::start_transparent_mode(
+  deadline p_timeout)
+{
+  if (m_connection_mode != connection_mode::single) {
+    return hal::new_error(std::errc::operation_not_supported);
+  }
+
+  HAL_CHECK(write(*m_serial, "AT+CIPMODE=1\r\n"));
+  HAL_CHECK(wait_for(response::ok, p_timeout));
+
+  // Without a length, CIPSEND forwards everything after the prompt
+  HAL_CHECK(write(*m_serial, "AT+CIPSEND\r\n"));
+  HAL_CHECK(wait_for(response::prompt, p_timeout));
+
+  return transparent_stream(*this);
+}
+
+hal::status at::stop_transparent_mode(deadline p_guard_before,
+                                      deadline p_guard_after,
+                                      deadline p_timeout)
+{
+  wait_until_expired(p_guard_before);
+  HAL_CHECK(write(*m_serial, "+++"));
+  wait_until_expired(p_guard_after);
+
+  // Anything left over from the transparent stream is not a response
+  m_packet_manager.discard();
+
+  HAL_CHECK(write(*m_serial, "AT+CIPMODE=0\r\n"));
+  HAL_CHECK(wait_for(response::ok, p_timeout));
+
+  return hal::success();
+}
+
+hal::result<at::link> at::get_link(std::uint8_t p_id)
+{
+  auto links =
+    m_connection_mode == connection_mode::multiple ? maximum_links : 1;
+
+  if (p_id >= links) {
+    return hal::new_error(std::errc::invalid_argument);
+  }
+
+  return link(*this, p_id);
+}
+
+hal::status at::start_server(std::uint16_t p_port, deadline p_timeout)
+{
+  if (m_connection_mode != connection_mode::multiple) {
+    return hal::new_error(std::errc::operation_not_permitted);
+  }
+
+  command_builder<command_length(
+    "AT+CIPSERVER=1,", integer_digits<std::uint16_t>(), "\r\n")>
+    command;
+  command.append("AT+CIPSERVER=1,").append(p_port).append("\r\n");
+  HAL_CHECK(command.write(*m_serial));
+  HAL_CHECK(wait_for(response::ok, p_timeout));
+
+  m_listening = true;
+  return hal::success();
+}
+
+hal::status at::stop_server(deadline p_timeout)
+{
+  HAL_CHECK(write(*m_serial, "AT+CIPSERVER=0\r\n"));
+  HAL_CHECK(wait_for(response::ok, p_timeout));
+
+  m_listening = false;
+  m_accept_queue = 0;
+  return hal::success();
+}
+
+hal::status at::set_server_timeout(hal::time_duration p_idle_time,
+                                   deadline p_timeout)
+{
+  constexpr std::uint16_t maximum_seconds = 7200;
+
+  auto seconds =
+    std::chrono::duration_cast<std::chrono::seconds>(p_idle_time).count();
+  if (seconds < 0 || seconds > maximum_seconds) {
+    return hal::new_error(std::errc::invalid_argument);
+  }
+
+  command_builder<command_length(
+    "AT+CIPSTO=", integer_digits<std::uint16_t>(), "\r\n")>
+    command;
+  command.append("AT+CIPSTO=")
+    .append(static_cast<std::uint16_t>(seconds))
+    .append("\r\n");
+  HAL_CHECK(command.write(*m_serial));
+  return wait_for(response::ok, p_timeout);
+}
+
+hal::result<at::link> at::accept()
+{
+  // The responses an operation is waiting for would be consumed here
+  if (is_busy()) {
+    return hal::new_error(std::errc::device_or_resource_busy);
+  }
+
+  HAL_CHECK(receive_packets());
+
+  for (std::uint8_t id = 0; id < maximum_links; id++) {
+    auto link_bit = static_cast<std::uint8_t>(1U << id);
+    if (m_accept_queue & link_bit) {
+      m_accept_queue &= static_cast<std::uint8_t>(~link_bit);
+      return link(*this, id);
+    }
+  }
+
+  return hal::new_error(std::errc::resource_unavailable_try_again);
+}
+
+hal::status at::write_uart_config(std::uint32_t p_baud_rate)
+{
+  command_builder<command_length("AT+UART_CUR=",
+                                 integer_digits<std::uint32_t>(),
+                                 ",8,1,0,",
+                                 integer_digits<std::uint8_t>(),
+                                 "\r\n")>
+    command;
+
+  // 8 data bits, 1 stop bit, no parity
+  command.append("AT+UART_CUR=")
+    .append(p_baud_rate)
+    .append(",8,1,0,")
+    .append(static_cast<std::uint8_t>(m_flow_control))
+    .append("\r\n");
+
+  return command.write(*m_serial);
+}
+
+hal::status at::configure_baud_rate(std::uint32_t p_baud_rate)
+{
+  // The stop bits and parity the port was set up with are kept
+  auto settings = m_serial_settings;
+  settings.baud_rate = static_cast<hal::hertz>(p_baud_rate);
+  HAL_CHECK(m_serial->configure(settings));
+  m_serial_settings = settings;
+
+  return hal::success();
+}
+
+hal::status at::switch_baud_rate(std::uint32_t p_baud_rate, deadline p_timeout)
+{
+  HAL_CHECK(configure_baud_rate(p_baud_rate));
+
+  // Anything received while the two sides disagreed is noise
+  HAL_CHECK(m_serial->flush());
+  m_packet_manager.discard();
+
+  HAL_CHECK(write(*m_serial, "AT\r\n"));
+  HAL_CHECK(wait_for(response::ok, p_timeout));
+  m_baud_rate = p_baud_rate;
+
+  return hal::success();
+}
+
+hal::status at::link_connect(std::uint8_t p_link,
+                             socket_config p_config,
+                             deadline p_timeout)
+{
+  auto domain = p_config.domain;
+
+  // Reconnects go straight to the address the domain last resolved to. The
+  // server's certificate is for its name, so SSL connections keep the name.
+  if (m_clock != nullptr && !is_ip_address(domain) &&
+      p_config.type != socket_type::ssl) {
+    p_config.domain = HAL_CHECK(resolve(domain, p_timeout));
+  }
+
+  auto connected = finish_operation(
+    HAL_CHECK(start_link_connect(p_link, p_config)), p_timeout);
+
+  // The server may have moved, so look it up again next time
+  if (!connected) {
+    forget_address(domain);
+  }
+
+  return connected;
+}
+
+hal::result<at::write_t> at::link_write(std::uint8_t p_link,
+                                        std::span<const hal::byte> p_data,
+                                        deadline p_timeout)
+{
+  HAL_CHECK(
+    finish_operation(HAL_CHECK(start_link_write(p_link, p_data)), p_timeout));
+  return write_t{ .data = p_data };
+}
+
+hal::result<bool> at::link_is_connected(std::uint8_t p_link,
+                                        deadline p_timeout)
+{
+  auto pending = HAL_CHECK(start_link_is_connected(p_link));
+  HAL_CHECK(finish_operation(pending, p_timeout));
+  return pending.result();
+}
+
+hal::result<at::read_t> at::link_read(std::uint8_t p_link,
+                                      std::span<hal::byte> p_buffer)
+{
+  // Format of a TCP packet for the ESP8266 AT commands:
+  //
+  //  +IPD,[0-9]+:[.*]{1460}
+  //  +IPD,[0-4],[0-9]+:[.*]{1460}  (multiple connection mode)
+  //
+  // Example:
+  //
+  //  +IPD,1230:
+  //
+  // Starts with a header, then length, then a ':' character, then 1 to 1460
+  // bytes worth of payload data.
+
+  // The responses an operation is waiting for would be consumed here
+  if (is_busy()) {
+    return hal::new_error(std::errc::device_or_resource_busy);
+  }
+
+  if (is_datagram_link(p_link)) {
+    auto received = HAL_CHECK(poll_datagram(p_link, p_buffer));
+    return read_t{ .data = received.data };
+  }
+
+  size_t bytes_read = 0;
+  auto buffer = p_buffer;
+  auto& ring = m_receive[p_link];
+
+  // Payload already held in the receive buffer must be handed out first
+  while (ring.size() != 0 && buffer.size() != 0) {
+    auto buffered = ring.readable(m_receive_storage);
+    auto length = std::min(buffered.size(), buffer.size());
+    std::copy_n(buffered.begin(), length, buffer.begin());
+    ring.release(length);
+    bytes_read += length;
+    buffer = buffer.subspan(length);
+  }
+
+  // With the receive buffer drained, the rest can be read directly into the
+  // caller's buffer. Payload for other links is parked in their receive
+  // buffers along the way.
+  while (buffer.size() != 0) {
+    // Notifications and stray responses between packets are dispatched and
+    // skipped over
+    auto token = scan_tokens();
+    if (!token) {
+      // Hand over what was read, the next read reports a malformed header. A
+      // failed read just means there is nothing more to receive for now.
+      if (bytes_read != 0 || !m_packet_manager.is_malformed()) {
+        break;
+      }
+      m_packet_manager.reset();
+      return token.error();
+    }
+    if (!m_packet_manager.is_complete_header()) {
+      if (token.value() == response::none) {
+        break;
+      }
+      continue;
+    }
+
+    auto id = m_packet_manager.link();
+    if (is_datagram_link(id)) {
+      if (HAL_CHECK(park_datagram()) == 0) {
+        break;
+      }
+      continue;
+    }
+
+    auto destination =
+      id == p_link ? buffer : m_receive[id].writable(m_receive_storage);
+
+    // Another link's receive buffer is full, so nothing behind it can be
+    // reached until that link is read.
+    if (destination.empty()) {
+      break;
+    }
+
+    auto read = m_packet_manager.read_packet(*m_serial, destination);
+
+    if (!read) {
+      // Don't lose what was already handed over from the receive buffer
+      if (bytes_read == 0) {
+        return read.error();
+      }
+      break;
+    }
+
+    if (read.value().size() == 0) {
+      break;
+    }
+
+    if (id == p_link) {
+      bytes_read += read.value().size();
+      buffer = buffer.subspan(read.value().size());
+    } else {
+      m_receive[id].commit(read.value().size());
+    }
+  }
 
   return read_t{ .data = p_buffer.first(bytes_read) };
 }
 
-hal::status at::disconnect_from_server(deadline p_timeout)
+hal::result<at::read_t> at::link_read(std::uint8_t p_link,
+                                      std::span<hal::byte> p_buffer,
+                                      deadline p_timeout)
+{
+  if (is_datagram_link(p_link)) {
+    auto received = HAL_CHECK(link_receive_from(p_link, p_buffer, p_timeout));
+    return read_t{ .data = received.data };
+  }
+
+  auto data = HAL_CHECK(link_read(p_link, p_buffer)).data;
+
+  if (m_receive_mode == receive_mode::active) {
+    return read_t{ .data = data };
+  }
+
+  auto pulled =
+    HAL_CHECK(link_pull(p_link, p_buffer.subspan(data.size()), p_timeout));
+
+  return read_t{ .data = p_buffer.first(data.size() + pulled) };
+}
+
+hal::result<std::size_t> at::link_pull(std::uint8_t p_link,
+                                       std::span<hal::byte> p_buffer,
+                                       deadline p_timeout)
+{
+  auto pending = m_packet_manager.pending(p_link);
+  auto request_length = std::min<std::size_t>(
+    { pending, p_buffer.size(), maximum_transmit_packet_size });
+
+  if (request_length == 0) {
+    return 0;
+  }
+
+  command_builder<command_length("AT+CIPRECVDATA=",
+                                 link_prefix_length,
+                                 integer_digits<std::uint16_t>(),
+                                 "\r\n")>
+    command;
+  command.append("AT+CIPRECVDATA=");
+  append_link_prefix(command, m_connection_mode, p_link);
+  command.append(static_cast<std::uint16_t>(request_length)).append("\r\n");
+  HAL_CHECK(command.write(*m_serial));
+
+  // Response layout differs between firmware versions:
+  //
+  //  +CIPRECVDATA,<actual length>:<data>   (1.7.x)
+  //  +CIPRECVDATA:<actual length>,<data>   (2.x)
+  HAL_CHECK(wait_for(response::receive_data, p_timeout));
+  std::array<hal::byte, 1> separator;
+  HAL_CHECK(read_exact(separator, p_timeout));
+  auto actual_length = HAL_CHECK(read_integer(p_timeout));
+  HAL_CHECK(read_exact(separator, p_timeout));
+
+  if (actual_length > request_length) {
+    return hal::new_error(std::errc::io_error);
+  }
+
+  HAL_CHECK(read_exact(p_buffer.first(actual_length), p_timeout));
+  HAL_CHECK(wait_for(response::ok, p_timeout));
+
+  // Getting less than requested means the module has nothing left to give
+  m_packet_manager.set_pending(
+    p_link, actual_length < request_length ? 0 : pending - actual_length);
+
+  return actual_length;
+}
+
+hal::result<std::span<const hal::byte>> at::link_acquire_read(
+  std::uint8_t p_link)
+{
+  // Lending out the receive buffer would expose the datagram framing
+  if (is_datagram_link(p_link)) {
+    return hal::new_error(std::errc::operation_not_supported);
+  }
+
+  // The responses an operation is waiting for would be consumed here
+  if (is_busy()) {
+    return hal::new_error(std::errc::device_or_resource_busy);
+  }
+
+  HAL_CHECK(receive_packets());
+  return m_receive[p_link].readable(m_receive_storage);
+}
+
+void at::link_release_read(std::uint8_t p_link, std::size_t p_length)
+{
+  m_receive[p_link].release(p_length);
+}
+
+hal::result<at::write_t> at::link_send_to(std::uint8_t p_link,
+                                          std::span<const hal::byte> p_data,
+                                          std::string_view p_address,
+                                          std::uint16_t p_port,
+                                          deadline p_timeout)
+{
+  if (is_busy()) {
+    return hal::new_error(std::errc::device_or_resource_busy);
+  }
+
+  // A datagram is never split across sends
+  if (p_data.empty() || p_data.size() > maximum_transmit_packet_size ||
+      !is_ip_address(p_address)) {
+    return hal::new_error(std::errc::invalid_argument);
+  }
+
+  //  AT+CIPSEND=[<link>,]<length>,"<ip>",<port>
+  command_builder<command_length("AT+CIPSEND=",
+                                 link_prefix_length,
+                                 integer_digits<std::uint16_t>(),
+                                 ",\"",
+                                 ip_max_length,
+                                 "\",",
+                                 integer_digits<std::uint16_t>(),
+                                 "\r\n")>
+    command;
+  command.append("AT+CIPSEND=");
+  append_link_prefix(command, m_connection_mode, p_link);
+  command.append(static_cast<std::uint16_t>(p_data.size()))
+    .append(",")
+    .append_quoted(p_address)
+    .append(",")
+    .append(p_port)
+    .append("\r\n");
+  HAL_CHECK(command.write(*m_serial));
+
+  HAL_CHECK(wait_for(response::prompt, p_timeout));
+  HAL_CHECK(hal::write(*m_serial, p_data));
+  HAL_CHECK(wait_for(response::send_ok, p_timeout));
+
+  return write_t{ .data = p_data };
+}
+
+hal::result<at::datagram> at::link_receive_from(std::uint8_t p_link,
+                                                std::span<hal::byte> p_buffer,
+                                                deadline p_timeout)
+{
+  if (!is_datagram_link(p_link)) {
+    return hal::new_error(std::errc::invalid_argument);
+  }
+
+  // The responses an operation is waiting for would be consumed here
+  if (is_busy()) {
+    return hal::new_error(std::errc::device_or_resource_busy);
+  }
+
+  HAL_CHECK(take_dropped_datagram(p_link));
+
+  datagram received{ .data = p_buffer.first(0) };
+
+  // Datagrams that arrived while the module was answering a command are
+  // handed out first. One that is still arriving is finished there.
+  while (m_receive[p_link].size() != 0) {
+    if (pop_datagram(p_link, p_buffer, received)) {
+      return received;
+    }
+    HAL_CHECK(p_timeout());
+    HAL_CHECK(receive_packets());
+  }
+
+  while (true) {
+    auto token = scan_tokens();
+    if (!token) {
+      // A failed read just means nothing has arrived
+      if (!m_packet_manager.is_malformed()) {
+        return received;
+      }
+      m_packet_manager.reset();
+      return token.error();
+    }
+    if (!m_packet_manager.is_complete_header()) {
+      if (token.value() == response::none) {
+        return received;
+      }
+      continue;
+    }
+
+    auto id = m_packet_manager.link();
+    if (id == p_link && m_packet_manager.is_new_packet()) {
+      break;
+    }
+
+    // Payload for other links is parked in their receive buffers
+    if (is_datagram_link(id)) {
+      if (HAL_CHECK(park_datagram()) == 0) {
+        return received;
+      }
+      continue;
+    }
+    auto space = m_receive[id].writable(m_receive_storage);
+    if (space.empty()) {
+      return received;
+    }
+    auto payload = HAL_CHECK(m_packet_manager.read_packet(*m_serial, space));
+    if (payload.empty()) {
+      return received;
+    }
+    m_receive[id].commit(payload.size());
+  }
+
+  // The datagram goes straight into the caller's buffer
+  auto address = m_packet_manager.remote_address();
+  std::copy(address.begin(), address.end(), received.address.begin());
+  received.address_length = static_cast<std::uint8_t>(address.size());
+  received.port = m_packet_manager.remote_port();
+
+  // Whatever is left if this gives up part way through is dropped
+  m_discard_packet = true;
+  std::size_t length = 0;
+  while (m_packet_manager.is_complete_header()) {
+    std::array<hal::byte, 32> discard;
+    auto into_buffer = length < p_buffer.size();
+    auto space =
+      into_buffer ? p_buffer.subspan(length) : std::span<hal::byte>(discard);
+    auto read = m_packet_manager.read_packet(*m_serial, space);
+    if (!read || read.value().empty()) {
+      HAL_CHECK(p_timeout());
+      continue;
+    }
+    if (into_buffer) {
+      length += read.value().size();
+    }
+  }
+
+  received.data = p_buffer.first(length);
+  return received;
+}
+
+hal::result<at::datagram> at::poll_datagram(std::uint8_t p_link,
+                                            std::span<hal::byte> p_buffer)
+{
+  // Everything that has arrived is parked, including a datagram for this
+  // link that is only partly there, so a later call can finish it
+  HAL_CHECK(receive_packets());
+  HAL_CHECK(take_dropped_datagram(p_link));
+
+  datagram received{ .data = p_buffer.first(0) };
+  pop_datagram(p_link, p_buffer, received);
+  return received;
+}
+
+bool at::pop_datagram(std::uint8_t p_link,
+                      std::span<hal::byte> p_buffer,
+                      datagram& p_received)
+{
+  auto& ring = m_receive[p_link];
+
+  std::array<hal::byte, datagram_header_size> header;
+  if (ring.peek(m_receive_storage, header) < header.size()) {
+    return false;
+  }
+  auto length = static_cast<std::size_t>(header[0] | (header[1] << 8));
+  auto address_length = header[4];
+
+  // The rest of the datagram is still on its way
+  if (ring.size() < header.size() + address_length + length) {
+    return false;
+  }
+
+  ring.discard(header.size());
+  p_received.port = static_cast<std::uint16_t>(header[2] | (header[3] << 8));
+  p_received.address_length = address_length;
+
+  std::array<hal::byte, sizeof(datagram::address)> address;
+  ring.read(m_receive_storage, std::span(address).first(address_length));
+  std::copy_n(address.begin(), address_length, p_received.address.begin());
+
+  auto copied = ring.read(m_receive_storage,
+                          p_buffer.first(std::min(length, p_buffer.size())));
+  ring.discard(length - copied);
+  p_received.data = p_buffer.first(copied);
+  return true;
+}
+
+bool at::is_datagram_link(std::uint8_t p_link) const
+{
+  return (m_datagram_links >> p_link) & 1U;
+}
+
+hal::result<std::size_t> at::park_datagram()
+{
+  auto id = m_packet_manager.link();
+  auto& ring = m_receive[id];
+
+  if (m_packet_manager.is_new_packet()) {
+    auto length = m_packet_manager.packet_length();
+    auto port = m_packet_manager.remote_port();
+    auto address = m_packet_manager.remote_address();
+
+    // A datagram is kept whole or not at all. One that fits once the link is
+    // read waits in the UART, one that never fits is dropped and reported by
+    // the next receive on its link.
+    auto size = datagram_header_size + address.size() + length;
+    m_discard_packet = ring.capacity() < size;
+    if (m_discard_packet) {
+      m_dropped_datagrams |= static_cast<std::uint8_t>(1U << id);
+    } else if (ring.available() < size) {
+      return 0;
+    } else {
+      std::array<hal::byte, datagram_header_size> header{
+        static_cast<hal::byte>(length & 0xFF),
+        static_cast<hal::byte>(length >> 8),
+        static_cast<hal::byte>(port & 0xFF),
+        static_cast<hal::byte>(port >> 8),
+        static_cast<hal::byte>(address.size()),
+      };
+      ring.write(m_receive_storage, header);
+      ring.write(m_receive_storage, hal::as_bytes(address));
+    }
+
+    // The header is only written once, even if no payload follows yet
+    m_packet_manager.claim();
+  }
+
+  if (m_discard_packet) {
+    std::array<hal::byte, 32> discard;
+    return HAL_CHECK(m_packet_manager.read_packet(*m_serial, discard)).size();
+  }
+
+  auto space = ring.writable(m_receive_storage);
+  auto payload = HAL_CHECK(m_packet_manager.read_packet(*m_serial, space));
+  ring.commit(payload.size());
+  return payload.size();
+}
+
+hal::status at::take_dropped_datagram(std::uint8_t p_link)
+{
+  auto link_bit = static_cast<std::uint8_t>(1U << p_link);
+  if (m_dropped_datagrams & link_bit) {
+    m_dropped_datagrams &= static_cast<std::uint8_t>(~link_bit);
+    return hal::new_error(std::errc::message_size);
+  }
+  return hal::success();
+}
+
+hal::status at::link_set_ssl_auth(std::uint8_t p_link,
+                                  ssl_auth p_auth,
+                                  deadline p_timeout)
+{
+  if (is_busy()) {
+    return hal::new_error(std::errc::device_or_resource_busy);
+  }
+
+  // In multiple connection mode the settings belong to one link:
+  //
+  //  AT+CIPSSLCCONF=<link>,<auth_mode>
+  command_builder<command_length("AT+CIPSSLCCONF=",
+                                 link_prefix_length,
+                                 integer_digits<std::uint8_t>(),
+                                 "\r\n")>
+    command;
+  command.append("AT+CIPSSLCCONF=");
+  append_link_prefix(command, m_connection_mode, p_link);
+  command.append(static_cast<std::uint8_t>(p_auth)).append("\r\n");
+  HAL_CHECK(command.write(*m_serial));
+  return wait_for(response::ok, p_timeout);
+}
+
+hal::status at::link_disconnect(std::uint8_t p_link, deadline p_timeout)
+{
+  return finish_operation(HAL_CHECK(start_link_disconnect(p_link)), p_timeout);
+}
+
+hal::result<at::operation> at::start_reset()
+{
+  HAL_CHECK(claim_operation(operation_kind::reset, 0));
+  return begin_operation();
+}
+
+hal::result<at::operation> at::start_connect_to_ap(std::string_view p_ssid,
+                                                   std::string_view p_password,
+                                                   std::string_view p_bssid)
+{
+  HAL_CHECK(claim_operation(operation_kind::connect_to_ap, 0));
+  m_operation.text = { p_ssid, p_password, p_bssid };
+  return begin_operation();
+}
+
+hal::result<at::operation> at::start_set_ip_address(std::string_view p_ip)
+{
+  HAL_CHECK(claim_operation(operation_kind::set_ip_address, 0));
+  m_operation.text = { p_ip };
+  return begin_operation();
+}
+
+hal::result<at::operation> at::start_is_connected_to_ap()
+{
+  HAL_CHECK(claim_operation(operation_kind::is_connected_to_ap, 0));
+  return begin_operation();
+}
+
+hal::result<at::operation> at::start_disconnect_from_ap()
+{
+  HAL_CHECK(claim_operation(operation_kind::disconnect_from_ap, 0));
+  return begin_operation();
+}
+
+hal::result<at::operation> at::start_connect_to_server(socket_config p_config)
+{
+  return start_link_connect(0, p_config);
+}
+
+hal::result<at::operation> at::start_is_connected_to_server()
+{
+  return start_link_is_connected(0);
+}
+
+hal::result<at::operation> at::start_server_write(
+  std::span<const hal::byte> p_data)
+{
+  return start_link_write(0, p_data);
+}
+
+hal::result<at::operation> at::start_disconnect_from_server()
+{
+  return start_link_disconnect(0);
+}
+
+bool at::is_busy() const
+{
+  return m_operation.state == hal::work_state::in_progress;
+}
+
+hal::result<at::operation> at::start_link_connect(std::uint8_t p_link,
+                                                  socket_config p_config)
 {
-  HAL_CHECK(write(*m_serial, "AT+CIPCLOSE=0\r\n"));
-  HAL_CHECK(wait_for_ok(m_serial, p_timeout));
+  HAL_CHECK(claim_operation(operation_kind::link_connect, p_link));
+  m_operation.config = p_config;
+
+  auto* entry = p_config.type == socket_type::ssl
+                  ? nullptr
+                  : find_dns_entry(p_config.domain);
+  if (entry != nullptr) {
+    m_operation.config.domain =
+      std::string_view(entry->address.data(), entry->address_length);
+  }
+
+  auto link_bit = static_cast<std::uint8_t>(1U << p_link);
+  if (p_config.type == socket_type::udp) {
+    m_datagram_links |= link_bit;
+  } else {
+    m_datagram_links &= static_cast<std::uint8_t>(~link_bit);
+  }
+
+  if (m_connect_clock != nullptr) {
+    m_connect_started = m_connect_clock->uptime().ticks;
+  }
+
+  // The module numbers buffered segments from the start of each connection
+  m_segments_queued = 0;
+  m_segments_acknowledged = 0;
+  m_segments_failed = 0;
+
+  return begin_operation();
+}
+
+hal::result<at::operation> at::start_link_is_connected(std::uint8_t p_link)
+{
+  HAL_CHECK(claim_operation(operation_kind::link_is_connected, p_link));
+  return begin_operation();
+}
+
+hal::result<at::operation> at::start_link_write(
+  std::uint8_t p_link,
+  std::span<const hal::byte> p_data)
+{
+  HAL_CHECK(claim_operation(operation_kind::link_write, p_link));
+  m_operation.data = p_data;
+  return begin_operation();
+}
+
+hal::result<at::operation> at::start_link_disconnect(std::uint8_t p_link)
+{
+  HAL_CHECK(claim_operation(operation_kind::link_disconnect, p_link));
+  return begin_operation();
+}
+
+hal::status at::claim_operation(operation_kind p_kind, std::uint8_t p_link)
+{
+  if (is_busy()) {
+    return hal::new_error(std::errc::device_or_resource_busy);
+  }
+
+  m_operation = operation_context{
+    .kind = p_kind,
+    .state = hal::work_state::in_progress,
+    .link = p_link,
+  };
+
+  return hal::success();
+}
+
+hal::result<at::operation> at::begin_operation()
+{
+  auto written = write_operation_step();
+  if (!written) {
+    fail_operation();
+    return written.error();
+  }
+
+  return operation(*this);
+}
+
+hal::status at::write_operation_step()
+{
+  auto& op = m_operation;
+
+  switch (op.kind) {
+    case operation_kind::reset:
+      if (op.step == 0) {
+        HAL_CHECK(write(*m_serial, "AT+RST\r\n"));
+      } else if (op.step == 1) {
+        // The module answers OK at the current rate and then reboots at its
+        // default rate, so follow it there. Switching any earlier could cut
+        // off AT+RST while it is still leaving the UART.
+        forget_session();
+        if (m_baud_rate != default_baud_rate) {
+          HAL_CHECK(configure_baud_rate(default_baud_rate));
+          m_baud_rate = default_baud_rate;
+        }
+        m_flow_control = flow_control::none;
+      } else {
+        // Turn off echo
+        HAL_CHECK(write(*m_serial, "ATE0\r\n"));
+      }
+      break;
+    case operation_kind::connect_to_ap:
+      if (op.step == 0) {
+        // Configure as WiFi Station (client) mode
+        HAL_CHECK(write(*m_serial, "AT+CWMODE=1\r\n"));
+      } else {
+        // Connect to wifi access point
+        command_builder<command_length("AT+CWJAP=\"",
+                                       ssid_max_length,
+                                       "\",\"",
+                                       password_max_length,
+                                       "\",\"",
+                                       bssid_length,
+                                       "\"\r\n")>
+          command;
+        command.append("AT+CWJAP=")
+          .append_quoted(op.text[0])
+          .append(",")
+          .append_quoted(op.text[1]);
+        // Joining a known BSSID skips the scan for the strongest AP
+        if (!op.text[2].empty()) {
+          command.append(",").append_quoted(op.text[2]);
+        }
+        command.append("\r\n");
+        HAL_CHECK(command.write(*m_serial));
+      }
+      break;
+    case operation_kind::set_ip_address: {
+      command_builder<command_length(
+        "AT+CIPSTA=\"", ip_max_length, "\"\r\n")>
+        command;
+      command.append("AT+CIPSTA=")
+        .append_quoted(op.text[0])
+        .append("\r\n");
+      HAL_CHECK(command.write(*m_serial));
+      break;
+    }
+    case operation_kind::is_connected_to_ap:
+      // Query the device to determine if it is still connected
+      HAL_CHECK(write(*m_serial, "AT+CWJAP?\r\n"));
+      break;
+    case operation_kind::disconnect_from_ap:
+      HAL_CHECK(write(*m_serial, "AT+CWQAP\r\n"));
+      break;
+    case operation_kind::link_connect: {
+      std::string_view socket_type_str;
+
+      switch (op.config.type) {
+        case socket_type::tcp:
+          socket_type_str = "TCP";
+          break;
+        case socket_type::udp:
+          socket_type_str = "UDP";
+          break;
+        case socket_type::ssl:
+          socket_type_str = "SSL";
+          break;
+      }
+
+      command_builder<command_length("AT+CIPSTART=",
+                                     link_prefix_length,
+                                     "\"TCP\",\"",
+                                     domain_max_length,
+                                     "\",",
+                                     integer_digits<std::uint16_t>(),
+                                     ",",
+                                     integer_digits<std::uint16_t>(),
+                                     ",2\r\n")>
+        command;
+
+      // Connect to web server
+      command.append("AT+CIPSTART=");
+      append_link_prefix(command, m_connection_mode, op.link);
+      command.append_quoted(socket_type_str)
+        .append(",")
+        .append_quoted(op.config.domain)
+        .append(",")
+        .append(op.config.port);
+      // A local port lets datagrams from any sender in (UDP mode 2)
+      if (op.config.type == socket_type::udp && op.config.local_port != 0) {
+        command.append(",").append(op.config.local_port).append(",2");
+      } else if (op.config.type != socket_type::udp &&
+                 op.config.keep_alive != 0) {
+        command.append(",").append(op.config.keep_alive);
+      }
+      command.append("\r\n");
+      HAL_CHECK(command.write(*m_serial));
+      break;
+    }
+    case operation_kind::link_is_connected:
+      // Query the device to determine if it is still connected
+      HAL_CHECK(write(*m_serial, "AT+CIPSTATUS\r\n"));
+      break;
+    case operation_kind::link_write: {
+      // AT+CIPSEND takes at most maximum_transmit_packet_size bytes at a
+      // time, so larger writes are sent as a series of full segments.
+      auto segment = op.data.subspan(op.sent);
+      segment = segment.first(
+        std::min(segment.size(), maximum_transmit_packet_size));
+
+      if (op.step == 0) {
+        command_builder<command_length("AT+CIPSEND=",
+                                       link_prefix_length,
+                                       integer_digits<std::uint16_t>(),
+                                       "\r\n")>
+          command;
+        command.append("AT+CIPSEND=");
+        append_link_prefix(command, m_connection_mode, op.link);
+        command.append(static_cast<std::uint16_t>(segment.size()))
+          .append("\r\n");
+        HAL_CHECK(command.write(*m_serial));
+      } else {
+        HAL_CHECK(hal::write(*m_serial, segment));
+      }
+      break;
+    }
+    case operation_kind::link_disconnect: {
+      // Single connection mode closes the connection with a bare
+      // AT+CIPCLOSE, multiple connection mode names the link:
+      //
+      //  AT+CIPCLOSE=<link>
+      command_builder<
+        command_length("AT+CIPCLOSE=", link_prefix_length, "\r\n")>
+        command;
+      command.append("AT+CIPCLOSE");
+      append_link_prefix(command, m_connection_mode, op.link, "=", "");
+      command.append("\r\n");
+      HAL_CHECK(command.write(*m_serial));
+      break;
+    }
+  }
 
   return hal::success();
 }
+
+hal::result<hal::work_state> at::advance_operation(response p_response)
+{
+  auto& op = m_operation;
+
+  switch (p_response) {
+    case response::error:
+    case response::fail:
+    case response::send_fail:
+      return hal::new_error(std::errc::io_error);
+    case response::busy:
+      // The module dropped the command without running it
+      return hal::new_error(std::errc::device_or_resource_busy);
+    default:
+      break;
+  }
+
+  // Answers to queries arrive before the final OK
+  if (op.kind == operation_kind::is_connected_to_ap &&
+      p_response == response::ap_connected) {
+    op.result = true;
+    return hal::work_state::in_progress;
+  }
+
+  // Each open link is reported on its own line:
+  //
+  //  +CIPSTATUS:<link>,<type>,<remote ip>,<remote port>,<local port>,<tetype>
+  if (op.kind == operation_kind::link_is_connected &&
+      p_response == response::server_status) {
+    op.reading_integer = true;
+    op.integer = 0;
+    return hal::work_state::in_progress;
+  }
+
+  if (p_response != operation_response(op.kind, op.step)) {
+    return hal::work_state::in_progress;
+  }
+
+  // The firmware rejects the next AT+CIPSEND until SEND OK, so a write with
+  // more segments to go starts over from the command.
+  if (op.kind == operation_kind::link_write &&
+      p_response == response::send_ok) {
+    op.sent += std::min(op.data.size() - op.sent, maximum_transmit_packet_size);
+    if (op.sent < op.data.size()) {
+      op.step = 0;
+      HAL_CHECK(write_operation_step());
+      return hal::work_state::in_progress;
+    }
+  }
+
+  op.step++;
+  if (operation_response(op.kind, op.step) == response::none) {
+    return hal::work_state::finished;
+  }
+
+  HAL_CHECK(write_operation_step());
+  return hal::work_state::in_progress;
+}
+
+at::response at::operation_response(operation_kind p_kind,
+                                     std::uint8_t p_step)
+{
+  // Responses that move each operation on to its next command, ending with
+  // `response::none`
+  constexpr std::array reset_steps{ response::ok,
+                                    response::ready,
+                                    response::ok,
+                                    response::none };
+  constexpr std::array connect_to_ap_steps{ response::ok, response::ok,
+                                            response::none };
+  constexpr std::array link_write_steps{ response::prompt, response::send_ok,
+                                         response::none };
+  constexpr std::array command_steps{ response::ok, response::none };
+
+  switch (p_kind) {
+    case operation_kind::reset:
+      // AT+RST, the reboot, then ATE0
+      return reset_steps[p_step];
+    case operation_kind::connect_to_ap:
+      // AT+CWMODE, then AT+CWJAP
+      return connect_to_ap_steps[p_step];
+    case operation_kind::link_write:
+      // AT+CIPSEND, then the payload
+      return link_write_steps[p_step];
+    default:
+      return command_steps[p_step];
+  }
+}
+
+hal::result<hal::work_state> at::poll_operation()
+{
+  auto& op = m_operation;
+
+  while (op.state == hal::work_state::in_progress) {
+    if (op.reading_integer) {
+      if (!HAL_CHECK(scan_integer(op.integer))) {
+        return hal::work_state::in_progress;
+      }
+      op.reading_integer = false;
+      if (op.integer == op.link) {
+        op.result = true;
+      }
+      continue;
+    }
+
+    auto token = HAL_CHECK(scan_response());
+    if (token == response::none) {
+      return hal::work_state::in_progress;
+    }
+
+    op.state = HAL_CHECK(advance_operation(token));
+
+    if (op.state == hal::work_state::finished &&
+        op.kind == operation_kind::link_connect &&
+        m_connect_clock != nullptr) {
+      auto ticks = m_connect_clock->uptime().ticks - m_connect_started;
+      auto frequency = static_cast<std::uint64_t>(
+        m_connect_clock->frequency().operating_frequency);
+      // Whole seconds and the remainder are scaled separately so the
+      // multiplication can't overflow
+      constexpr std::uint64_t nanoseconds_per_second = 1'000'000'000;
+      m_connect_time = std::chrono::nanoseconds(
+        (ticks / frequency) * nanoseconds_per_second +
+        (ticks % frequency) * nanoseconds_per_second / frequency);
+    }
+  }
+
+  return op.state;
+}
+
+void at::fail_operation()
+{
+  // A UDP connection that didn't open mustn't turn the link's next TCP
+  // payload into datagrams
+  if (is_busy() && m_operation.kind == operation_kind::link_connect) {
+    m_datagram_links &= static_cast<std::uint8_t>(~(1U << m_operation.link));
+  }
+
+  m_operation.state = hal::work_state::failed;
+}
+
+hal::status at::finish_operation(operation p_operation, deadline p_timeout)
+{
+  while (true) {
+    auto state = HAL_CHECK(p_operation.poll());
+    if (state == hal::work_state::finished) {
+      return hal::success();
+    }
+
+    auto timed_out = p_timeout();
+    if (!timed_out) {
+      p_operation.cancel();
+      return timed_out;
+    }
+  }
+}
+
+at::link::link(at& p_driver, std::uint8_t p_id)
+  : m_driver(&p_driver)
+  , m_id(p_id)
+{
+}
+
+hal::status at::link::connect(socket_config p_config, deadline p_timeout)
+{
+  return m_driver->link_connect(m_id, p_config, p_timeout);
+}
+
+hal::result<bool> at::link::is_connected(deadline p_timeout)
+{
+  return m_driver->link_is_connected(m_id, p_timeout);
+}
+
+hal::result<at::write_t> at::link::write(std::span<const hal::byte> p_data,
+                                         deadline p_timeout)
+{
+  return m_driver->link_write(m_id, p_data, p_timeout);
+}
+
+hal::result<at::read_t> at::link::read(std::span<hal::byte> p_data)
+{
+  return m_driver->link_read(m_id, p_data);
+}
+
+hal::result<at::read_t> at::link::read(std::span<hal::byte> p_data,
+                                       deadline p_timeout)
+{
+  return m_driver->link_read(m_id, p_data, p_timeout);
+}
+
+hal::result<std::span<const hal::byte>> at::link::acquire_read()
+{
+  return m_driver->link_acquire_read(m_id);
+}
+
+void at::link::release_read(std::size_t p_length)
+{
+  m_driver->link_release_read(m_id, p_length);
+}
+
+hal::result<at::write_t> at::link::send_to(std::span<const hal::byte> p_data,
+                                           std::string_view p_address,
+                                           std::uint16_t p_port,
+                                           deadline p_timeout)
+{
+  return m_driver->link_send_to(m_id, p_data, p_address, p_port, p_timeout);
+}
+
+hal::result<at::datagram> at::link::receive_from(std::span<hal::byte> p_buffer,
+                                                 deadline p_timeout)
+{
+  return m_driver->link_receive_from(m_id, p_buffer, p_timeout);
+}
+
+hal::status at::link::set_ssl_auth(ssl_auth p_auth, deadline p_timeout)
+{
+  return m_driver->link_set_ssl_auth(m_id, p_auth, p_timeout);
+}
+
+hal::status at::link::disconnect(deadline p_timeout)
+{
+  return m_driver->link_disconnect(m_id, p_timeout);
+}
+
+hal::result<at::operation> at::link::start_connect(socket_config p_config)
+{
+  return m_driver->start_link_connect(m_id, p_config);
+}
+
+hal::result<at::operation> at::link::start_is_connected()
+{
+  return m_driver->start_link_is_connected(m_id);
+}
+
+hal::result<at::operation> at::link::start_write(
+  std::span<const hal::byte> p_data)
+{
+  return m_driver->start_link_write(m_id, p_data);
+}
+
+hal::result<at::operation> at::link::start_disconnect()
+{
+  return m_driver->start_link_disconnect(m_id);
+}
+
+std::uint8_t at::link::id() const
+{
+  return m_id;
+}
+
+at::operation::operation(at& p_driver)
+  : m_driver(&p_driver)
+{
+}
+
+hal::result<hal::work_state> at::operation::poll()
+{
+  auto state = m_driver->poll_operation();
+  if (!state) {
+    cancel();
+  }
+  return state;
+}
+
+hal::result<hal::work_state> at::operation::operator()()
+{
+  return poll();
+}
+
+hal::work_state at::operation::state() const
+{
+  return m_driver->m_operation.state;
+}
+
+void at::operation::cancel()
+{
+  m_driver->fail_operation();
+}
+
+bool at::operation::result() const
+{
+  return m_driver->m_operation.result;
+}
+
+at::transparent_stream::transparent_stream(at& p_driver)
+  : m_driver(&p_driver)
+{
+}
+
+hal::status at::transparent_stream::driver_configure(const settings&)
+{
+  // Reconfiguring the UART would break the link to the module
+  return hal::new_error(std::errc::operation_not_supported);
+}
+
+hal::result<hal::serial::write_t> at::transparent_stream::driver_write(
+  std::span<const hal::byte> p_data)
+{
+  return m_driver->m_serial->write(p_data);
+}
+
+hal::result<hal::serial::read_t> at::transparent_stream::driver_read(
+  std::span<hal::byte> p_data)
+{
+  auto& packet_manager = m_driver->m_packet_manager;
+  auto buffered = packet_manager.buffered();
+
+  if (buffered.empty()) {
+    return m_driver->m_serial->read(p_data);
+  }
+
+  // Bytes that followed the prompt were already pulled into the window
+  auto length = std::min(buffered.size(), p_data.size());
+  std::copy_n(buffered.begin(), length, p_data.begin());
+  packet_manager.consume(length);
+
+  return read_t{
+    .data = p_data.first(length),
+    .available = buffered.size() - length,
+    .capacity = buffered.size(),
+  };
+}
+
+hal::result<hal::serial::flush_t> at::transparent_stream::driver_flush()
+{
+  m_driver->m_packet_manager.discard();
+  return m_driver->m_serial->flush();
+}
 }  // namespace hal::esp8266
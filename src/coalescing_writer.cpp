@@ -0,0 +1,101 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <libhal-esp8266/coalescing_writer.hpp>
+
+#include <algorithm>
+
+#include <libhal-util/steady_clock.hpp>
+
+namespace hal::esp8266 {
+result<coalescing_writer> coalescing_writer::create(
+  at::link p_link,
+  hal::steady_clock& p_clock,
+  std::size_t p_threshold,
+  hal::time_duration p_max_latency)
+{
+  if (p_threshold == 0 || p_threshold > buffer_size) {
+    return hal::new_error(std::errc::invalid_argument);
+  }
+
+  return coalescing_writer(p_link, p_clock, p_threshold, p_max_latency);
+}
+
+coalescing_writer::coalescing_writer(at::link p_link,
+                                     hal::steady_clock& p_clock,
+                                     std::size_t p_threshold,
+                                     hal::time_duration p_max_latency)
+  : m_link(p_link)
+  , m_clock(&p_clock)
+  , m_threshold(p_threshold)
+  , m_max_latency(p_max_latency)
+  , m_deadline(0)
+  , m_length(0)
+{
+}
+
+hal::status coalescing_writer::write(std::span<const hal::byte> p_data,
+                                     at::deadline p_timeout)
+{
+  if (p_data.size() > m_buffer.size() - m_length) {
+    HAL_CHECK(flush(p_timeout));
+  }
+
+  // Too big to batch at all
+  if (p_data.size() > m_buffer.size()) {
+    HAL_CHECK(m_link.write(p_data, p_timeout));
+    return hal::success();
+  }
+
+  // The latency bound starts with the first byte of a batch
+  if (m_length == 0) {
+    m_deadline = hal::future_deadline(*m_clock, m_max_latency);
+  }
+
+  std::copy(p_data.begin(), p_data.end(), m_buffer.begin() + m_length);
+  m_length += p_data.size();
+
+  if (m_length >= m_threshold) {
+    HAL_CHECK(flush(p_timeout));
+  }
+
+  return hal::success();
+}
+
+hal::status coalescing_writer::flush(at::deadline p_timeout)
+{
+  if (m_length == 0) {
+    return hal::success();
+  }
+
+  HAL_CHECK(m_link.write(std::span(m_buffer).first(m_length), p_timeout));
+  m_length = 0;
+
+  return hal::success();
+}
+
+hal::status coalescing_writer::poll(at::deadline p_timeout)
+{
+  if (m_length != 0 && m_clock->uptime().ticks >= m_deadline) {
+    HAL_CHECK(flush(p_timeout));
+  }
+
+  return hal::success();
+}
+
+std::size_t coalescing_writer::size() const
+{
+  return m_length;
+}
+}  // namespace hal::esp8266
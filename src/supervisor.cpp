@@ -0,0 +1,159 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <libhal-esp8266/supervisor.hpp>
+
+#include <algorithm>
+
+#include <libhal-util/steady_clock.hpp>
+
+namespace hal::esp8266 {
+result<supervisor> supervisor::create(at& p_driver,
+                                      hal::steady_clock& p_clock,
+                                      const settings& p_settings)
+{
+  if (p_settings.min_backoff <= hal::time_duration(0) ||
+      p_settings.max_backoff < p_settings.min_backoff) {
+    return hal::new_error(std::errc::invalid_argument);
+  }
+
+  return supervisor(p_driver, p_clock, p_settings);
+}
+
+supervisor::supervisor(at& p_driver,
+                       hal::steady_clock& p_clock,
+                       const settings& p_settings)
+  : m_driver(&p_driver)
+  , m_clock(&p_clock)
+  , m_settings(p_settings)
+  , m_ap(link_state::unknown)
+  , m_server(link_state::unknown)
+  , m_backoff(p_settings.min_backoff)
+  , m_retry_at(0)
+  , m_failures(0)
+  , m_bssid_known(false)
+{
+}
+
+hal::work_state supervisor::poll(at::deadline p_timeout)
+{
+  if (m_driver->is_busy() || m_clock->uptime().ticks < m_retry_at) {
+    return hal::work_state::in_progress;
+  }
+
+  if (m_ap == link_state::unknown) {
+    auto connected = m_driver->is_connected_to_ap(p_timeout);
+    if (!connected) {
+      return retry_later();
+    }
+    m_ap = connected.value() ? link_state::up : link_state::down;
+  }
+
+  if (m_ap == link_state::down) {
+    // With a static address the module is ready as soon as it associates
+    if (!m_settings.network.ip.empty() &&
+        !m_driver->set_network_config(m_settings.network, p_timeout)) {
+      return retry_later();
+    }
+
+    auto bssid = m_bssid_known
+                   ? std::string_view(m_bssid.data(), m_bssid.size())
+                   : std::string_view();
+    if (!m_driver->connect_to_ap(
+          m_settings.ssid, m_settings.password, bssid, p_timeout)) {
+      // The access point may be gone, so scan for one next time
+      m_bssid_known = false;
+      return retry_later();
+    }
+
+    // Remember the access point so rejoining it skips the scan
+    if (!m_bssid_known) {
+      if (auto joined = m_driver->connected_access_point(p_timeout)) {
+        m_bssid = joined.value().bssid;
+        m_bssid_known = true;
+      }
+    }
+
+    m_ap = link_state::up;
+    // Connections do not survive leaving the access point
+    m_server = link_state::down;
+  }
+
+  if (m_server == link_state::unknown) {
+    auto connected = m_driver->is_connected_to_server(p_timeout);
+    if (!connected) {
+      return retry_later();
+    }
+    m_server = connected.value() ? link_state::up : link_state::down;
+  }
+
+  if (m_server == link_state::down) {
+    if (!m_driver->connect_to_server(m_settings.server, p_timeout)) {
+      // The access point may have gone without saying so, check it first
+      // next time
+      m_ap = link_state::unknown;
+      return retry_later();
+    }
+    m_server = link_state::up;
+  }
+
+  m_backoff = m_settings.min_backoff;
+  m_failures = 0;
+  return hal::work_state::finished;
+}
+
+void supervisor::handle_event(at::event p_event, std::uint8_t p_link)
+{
+  switch (p_event) {
+    case at::event::ap_disconnected:
+      m_ap = link_state::down;
+      m_server = link_state::down;
+      break;
+    case at::event::got_ip:
+      // The module rejoined on its own, keeping any static address
+      m_ap = link_state::up;
+      break;
+    case at::event::link_closed:
+      if (p_link == 0) {
+        m_server = link_state::down;
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+void supervisor::connection_lost()
+{
+  m_server = link_state::unknown;
+}
+
+bool supervisor::is_connected() const
+{
+  return m_ap == link_state::up && m_server == link_state::up;
+}
+
+std::uint32_t supervisor::failures() const
+{
+  return m_failures;
+}
+
+hal::work_state supervisor::retry_later()
+{
+  m_failures++;
+  m_retry_at = hal::future_deadline(*m_clock, m_backoff);
+  m_backoff = std::min(m_backoff * 2, m_settings.max_backoff);
+  return hal::work_state::in_progress;
+}
+}  // namespace hal::esp8266
@@ -14,8 +14,10 @@
 
 #pragma once
 
-#include <charconv>
+#include <array>
 #include <concepts>
+#include <cstdint>
+#include <limits>
 #include <span>
 #include <string_view>
 
@@ -30,57 +32,371 @@ namespace hal::esp8266 {
 /// Default baud rate for the esp8266 AT commands
 constexpr std::uint32_t default_baud_rate = 115200;
 constexpr auto ok_response = std::string_view("OK\r\n");
+constexpr auto error_response = std::string_view("ERROR\r\n");
+constexpr auto fail_response = std::string_view("FAIL\r\n");
 constexpr auto got_ip_response = std::string_view("WIFI GOT IP\r\n");
 constexpr auto reset_complete = std::string_view("ready\r\n");
 constexpr auto start_of_packet = std::string_view("+IPD,");
 constexpr auto end_of_line = std::string_view("\r\n");
 constexpr auto end_of_header = std::string_view("\r\n\r\n");
 constexpr auto send_finished = std::string_view("SEND OK\r\n");
-constexpr auto ap_connected = std::string_view("+CWJAP:");
+constexpr auto send_failed = std::string_view("SEND FAIL\r\n");
+constexpr auto send_prompt = std::string_view(">");
+constexpr auto ap_connected_token = std::string_view("+CWJAP:");
+constexpr auto server_status_token = std::string_view("+CIPSTATUS:");
+constexpr auto receive_data_token = std::string_view("+CIPRECVDATA");
+constexpr auto busy_processing = std::string_view("busy p...\r\n");
+constexpr auto segment_sent_token = std::string_view(",SEND OK\r\n");
+constexpr auto segment_failed_token = std::string_view(",SEND FAIL\r\n");
+constexpr auto segment_received_token = std::string_view("Recv ");
+constexpr auto connect_notice = std::string_view("CONNECT\r\n");
+constexpr auto link_connect_notice = std::string_view(",CONNECT\r\n");
+constexpr auto closed_notice = std::string_view("CLOSED\r\n");
+constexpr auto link_closed_notice = std::string_view(",CLOSED\r\n");
+constexpr auto wifi_connected_token = std::string_view("WIFI CONNECTED\r\n");
+constexpr auto wifi_disconnected_token =
+  std::string_view("WIFI DISCONNECT\r\n");
+constexpr auto domain_address_token = std::string_view("+CIPDOMAIN:");
+constexpr auto mux_status_token = std::string_view("+CIPMUX:");
+constexpr auto receive_mode_status_token = std::string_view("+CIPRECVMODE:");
+constexpr auto scan_entry_token = std::string_view("+CWLAP:");
 /// The maximum packet size for wlan_client AT commands
 constexpr size_t maximum_response_packet_size = 1460UL;
 constexpr size_t maximum_transmit_packet_size = 2048UL;
 constexpr size_t ssid_max_length = 32;
+constexpr size_t password_max_length = 64;
+/// Length of a MAC address, "aa:bb:cc:dd:ee:ff"
+constexpr size_t bssid_length = 17;
+/// Longest domain name accepted by AT+CIPSTART
+constexpr size_t domain_max_length = 64;
+/// Longest dotted IPv4 address, "255.255.255.255"
+constexpr size_t ip_max_length = 15;
+/// Length of the "<link>," field in multiple connection mode
+constexpr size_t link_prefix_length = 2;
+/// Longest command the AT firmware accepts, not counting the "\r\n"
+constexpr size_t command_max_length = 256;
 
 /**
- * @brief Convert integer to strings and perform error code checking
+ * @return size_t - number of characters needed for any value of an unsigned
+ * integer type
+ */
+template<std::unsigned_integral integer>
+consteval size_t integer_digits()
+{
+  return std::numeric_limits<integer>::digits10 + 1;
+}
+
+consteval size_t command_part_length(std::string_view p_text)
+{
+  return p_text.size();
+}
+
+consteval size_t command_part_length(size_t p_field_length)
+{
+  return p_field_length;
+}
+
+/**
+ * @brief Longest possible length of a command
+ *
+ * @param p_parts - the fixed text of the command and the maximum length of
+ * each of its fields, in any order
+ * @return size_t - capacity to give a `command_builder` for the command
+ */
+consteval size_t command_length(auto... p_parts)
+{
+  return (command_part_length(p_parts) + ...);
+}
+
+/**
+ * @brief Assemble a whole command line so it can be sent with one write
+ *
+ * Every call to `hal::write()` is a separate transfer through the serial
+ * driver, so building the command on the stack first keeps the number of
+ * transfers per command at one. Size the buffer with `command_length()` so
+ * that a command with every field at its maximum length fits.
  *
- * @tparam digits - allocates this many digits to store the integer. Set to 10
- * to be able to hold the maximum value of a uint32_t. Set to 20 to store
- * support.
+ * Usage:
  *
+ *    command_builder<command_length("AT+CIPCLOSE=",
+ *                                   integer_digits<std::uint8_t>(),
+ *                                   "\r\n")> command;
+ *    command.append("AT+CIPCLOSE=").append(link).append("\r\n");
+ *    HAL_CHECK(command.write(serial));
+ *
+ * @tparam capacity - maximum length of the command in bytes
  */
-template<size_t digits = 10>
-class integer_string
+template<size_t capacity>
+class command_builder
 {
 public:
-  static result<integer_string> create(std::integral auto p_integer)
+  constexpr command_builder& append(std::string_view p_text)
   {
-    integer_string result;
-    auto chars_result = std::to_chars(
-      result.m_buffer.begin(), result.m_buffer.end(), p_integer, 10);
+    if (p_text.size() > capacity - m_length) {
+      m_overflow = true;
+      return *this;
+    }
 
-    if (chars_result.ec != std::errc()) {
-      return hal::new_error(chars_result.ec);
+    for (auto character : p_text) {
+      m_buffer[m_length++] = static_cast<hal::byte>(character);
     }
+    return *this;
+  }
+
+  constexpr command_builder& append(std::unsigned_integral auto p_integer)
+  {
+    std::array<char, integer_digits<decltype(p_integer)>()> digits{};
+    auto start = digits.size();
+    do {
+      digits[--start] = static_cast<char>('0' + p_integer % 10);
+      p_integer /= 10;
+    } while (p_integer != 0);
+
+    return append(
+      std::string_view(digits.data() + start, digits.size() - start));
+  }
+
+  /// Append text surrounded by double quotes
+  constexpr command_builder& append_quoted(std::string_view p_text)
+  {
+    return append("\"").append(p_text).append("\"");
+  }
 
-    result.m_length =
-      std::span<char>(result.m_buffer.data(), chars_result.ptr).size();
+  constexpr std::span<const hal::byte> bytes() const
+  {
+    return std::span<const hal::byte>(m_buffer.data(), m_length);
+  }
 
-    return result;
+  /**
+   * @return hal::result<std::string_view> - the command as text, or
+   * `std::errc::invalid_argument` if a field was longer than the command has
+   * room for
+   */
+  hal::result<std::string_view> str() const
+  {
+    if (m_overflow) {
+      return hal::new_error(std::errc::invalid_argument);
+    }
+    return std::string_view(reinterpret_cast<const char*>(m_buffer.data()),
+                            m_length);
   }
 
-  std::string_view str() const
+  /**
+   * @brief Send the command in a single write
+   *
+   * @param p_serial - serial port to write to
+   * @return hal::status - `std::errc::invalid_argument` if a field was longer
+   * than the command has room for, in which case nothing is written
+   */
+  hal::status write(hal::serial& p_serial) const
   {
-    return std::string_view(m_buffer.data(), m_length);
+    if (m_overflow) {
+      return hal::new_error(std::errc::invalid_argument);
+    }
+    HAL_CHECK(hal::write(p_serial, bytes()));
+    return hal::success();
   }
 
 private:
-  integer_string()
+  std::array<hal::byte, capacity> m_buffer{};
+  size_t m_length = 0;
+  bool m_overflow = false;
+};
+
+/**
+ * @brief Aho-Corasick automaton matching a fixed set of tokens in one pass
+ *
+ * Bytes that do not appear in any token share input class 0, so the
+ * transition table only needs one column per distinct token byte. Every
+ * transition, including failure links, is resolved at compile time so
+ * matching is a single table lookup per byte.
+ *
+ * @tparam state_count - number of nodes in the token trie, root included
+ * @tparam class_count - number of distinct token bytes plus one
+ */
+template<size_t state_count, size_t class_count>
+struct token_automaton
+{
+  static_assert(state_count <= 256, "Token states must fit within 8-bits");
+
+  std::array<std::uint8_t, 256> byte_class{};
+  std::array<std::array<std::uint8_t, class_count>, state_count> next{};
+  /// Token number (index + 1) of the longest token ending at each state or 0
+  std::array<std::uint8_t, state_count> token{};
+};
+
+template<size_t token_count>
+consteval size_t token_state_count(
+  const std::array<std::string_view, token_count>& p_tokens)
+{
+  size_t count = 1;
+  for (size_t i = 0; i < token_count; i++) {
+    for (size_t length = 1; length <= p_tokens[i].size(); length++) {
+      auto prefix = p_tokens[i].substr(0, length);
+      bool shared = false;
+      for (size_t j = 0; j < i; j++) {
+        shared = shared || p_tokens[j].substr(0, length) == prefix;
+      }
+      if (!shared) {
+        count++;
+      }
+    }
+  }
+  return count;
+}
+
+template<size_t token_count>
+consteval size_t token_class_count(
+  const std::array<std::string_view, token_count>& p_tokens)
+{
+  std::array<bool, 256> used{};
+  size_t count = 1;
+  for (auto token : p_tokens) {
+    for (auto character : token) {
+      auto& entry = used[static_cast<std::uint8_t>(character)];
+      if (!entry) {
+        entry = true;
+        count++;
+      }
+    }
+  }
+  return count;
+}
+
+/**
+ * @brief Build the automaton for a constexpr array of tokens
+ *
+ * @tparam tokens - array of tokens, matches are reported as index + 1
+ */
+template<const auto& tokens>
+consteval auto make_token_automaton()
+{
+  constexpr auto state_count = token_state_count(tokens);
+  constexpr auto class_count = token_class_count(tokens);
+  static_assert(tokens.size() < 256, "Token numbers must fit within 8-bits");
+
+  token_automaton<state_count, class_count> automaton{};
+
+  std::uint8_t classes = 1;
+  for (auto token : tokens) {
+    for (auto character : token) {
+      auto& entry = automaton.byte_class[static_cast<std::uint8_t>(character)];
+      if (entry == 0) {
+        entry = classes++;
+      }
+    }
+  }
+
+  // Build the trie. The root is never a child, so an edge to state 0 means
+  // that no edge exists yet.
+  std::array<std::uint8_t, state_count> own_token{};
+  std::uint8_t states = 1;
+  for (size_t i = 0; i < tokens.size(); i++) {
+    std::uint8_t state = 0;
+    for (auto character : tokens[i]) {
+      auto input = automaton.byte_class[static_cast<std::uint8_t>(character)];
+      if (automaton.next[state][input] == 0) {
+        automaton.next[state][input] = states++;
+      }
+      state = automaton.next[state][input];
+    }
+    own_token[state] = static_cast<std::uint8_t>(i + 1);
+  }
+
+  // Resolve failure links breadth first so that every state shallower than
+  // the current one already has a complete row of transitions.
+  std::array<std::uint8_t, state_count> fail{};
+  std::array<std::uint8_t, state_count> queue{};
+  size_t head = 0;
+  size_t tail = 0;
+
+  for (size_t input = 0; input < class_count; input++) {
+    if (auto child = automaton.next[0][input]; child != 0) {
+      queue[tail++] = child;
+    }
+  }
+
+  while (head < tail) {
+    auto state = queue[head++];
+    automaton.token[state] = own_token[state] != 0
+                               ? own_token[state]
+                               : automaton.token[fail[state]];
+
+    for (size_t input = 0; input < class_count; input++) {
+      auto fallback = automaton.next[fail[state]][input];
+      if (auto child = automaton.next[state][input]; child != 0) {
+        fail[child] = fallback;
+        queue[tail++] = child;
+      } else {
+        automaton.next[state][input] = fallback;
+      }
+    }
+  }
+
+  return automaton;
+}
+
+/**
+ * @brief Streaming matcher over an automaton from make_token_automaton()
+ *
+ * Partial matches are carried across calls to `scan()` so tokens may be split
+ * between serial reads.
+ *
+ * @tparam automaton - automaton to walk
+ */
+template<const auto& automaton>
+class token_matcher
+{
+public:
+  struct match_t
+  {
+    /// Token number (index + 1) of the matched token or 0 if none was found
+    std::uint8_t token;
+    /// Bytes consumed up to and including the end of the matched token
+    size_t length;
+  };
+
+  /**
+   * @brief Scan bytes until the end of the first token
+   *
+   * @param p_input - bytes to scan
+   * @return match_t - the token found and where it ended. If no token was
+   * found, then the whole input was consumed.
+   */
+  constexpr match_t scan(std::span<const hal::byte> p_input)
+  {
+    for (size_t i = 0; i < p_input.size(); i++) {
+      m_state = automaton.next[m_state][automaton.byte_class[p_input[i]]];
+      if (auto token = automaton.token[m_state]; token != 0) {
+        m_state = 0;
+        return { .token = token, .length = i + 1 };
+      }
+    }
+    return { .token = 0, .length = p_input.size() };
+  }
+
+  constexpr void reset()
+  {
+    m_state = 0;
+  }
+
+  /**
+   * @return std::uint8_t - progress through a partial match, can be passed
+   * to the constructor to resume matching later
+   */
+  constexpr std::uint8_t state() const
   {
+    return m_state;
   }
 
-  std::array<char, digits> m_buffer{};
-  size_t m_length;
+  constexpr token_matcher() = default;
+
+  constexpr explicit token_matcher(std::uint8_t p_state)
+    : m_state(p_state)
+  {
+  }
+
+private:
+  std::uint8_t m_state = 0;
 };
 }  // namespace hal::esp8266
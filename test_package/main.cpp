@@ -12,6 +12,8 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <array>
+
 #include <libhal-esp8266/at.hpp>
 #include <libhal-util/steady_clock.hpp>
 #include <libhal/timeout.hpp>
@@ -25,9 +27,12 @@ int main()
   using namespace std::literals;
   hal::esp8266::mock_serial mock;
   mock.m_stream_out = hal::esp8266::stream_out(
-    "ready\r\n OK\r\n OK\r\n OK\r\n OK\r\n OK\r\n>SEND OK\r\n"sv);
+    "\r\nOK\r\nready\r\n OK\r\n OK\r\n OK\r\n OK\r\n OK\r\n>SEND OK\r\n"sv);
 
-  auto at = hal::esp8266::at::create(mock, hal::never_timeout()).value();
+  std::array<hal::byte, 2048> receive_buffer{};
+  auto at =
+    hal::esp8266::at::create(mock, receive_buffer, hal::never_timeout())
+      .value();
   HAL_IGNORE(at.connect_to_ap("ssid", "password", hal::never_timeout()));
   HAL_IGNORE(at.connect_to_server(
     {
@@ -1,5 +1,12 @@
 #include <libhal-esp8266/at.hpp>
 
+#include <array>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
 #include "helpers.hpp"
 
 #include <boost/ut.hpp>
@@ -13,11 +20,1148 @@ void at_test()
     using namespace std::literals;
     // Setup
     mock_serial mock;
-    mock.m_stream_out = stream_out("ready\r\n OK\r\n OK\r\n"sv);
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+
+    // Exercise
+    // Verify
+    [[maybe_unused]] auto at =
+      at::create(mock, receive_buffer, hal::never_timeout()).value();
+  };
+
+  "at::reset() returns to single connection mode"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    mock.m_stream_out = stream_out("\r\nOK\r\n\r\nOK\r\nready\r\n OK\r\n"
+                                   "CONNECT\r\n\r\nOK\r\n+IPD,5:hello"sv);
+    std::array<hal::byte, 8> buffer{};
+
+    // Exercise
+    at.set_connection_mode(at::connection_mode::multiple,
+                           hal::never_timeout())
+      .value();
+    at.reset(hal::never_timeout()).value();
+    mock.m_written.clear();
+    at.connect_to_server({ .domain = "example.com" }, hal::never_timeout())
+      .value();
+    auto data = at.server_read(buffer).value().data;
+
+    // Verify
+    expect("AT+CIPSTART=\"TCP\",\"example.com\",80\r\n"sv == mock.m_written);
+    expect("hello"sv ==
+           std::string_view(reinterpret_cast<const char*>(data.data()),
+                            data.size()));
+    expect(!at.get_link(1));
+  };
+
+  "at::server_read() skips status text between packets"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    mock.m_stream_out =
+      stream_out("\r\nWIFI GOT IP\r\n+IPD,5:Hello\r\nOK\r\n+IPD,7:, World"sv);
+    std::array<hal::byte, 64> buffer{};
+
+    // Exercise
+    auto data = at.server_read(buffer).value().data;
+
+    // Verify
+    expect("Hello, World"sv ==
+           std::string_view(reinterpret_cast<const char*>(data.data()),
+                            data.size()));
+  };
+
+  "at::server_read() splits a packet across small buffers"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    mock.m_stream_out = stream_out("+IPD,10:0123456789+IPD,2:ab"sv);
+    std::array<hal::byte, 4> buffer{};
+    std::string received;
+
+    // Exercise
+    for (int i = 0; i < 4; i++) {
+      auto data = at.server_read(buffer).value().data;
+      received.append(reinterpret_cast<const char*>(data.data()), data.size());
+    }
+
+    // Verify
+    expect("0123456789ab"sv == received);
+  };
+
+  "at::acquire_read() + ::release_read()"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    mock.m_stream_out = stream_out("+IPD,5:Hello\r\n+IPD,7:, World"sv);
+    std::array<hal::byte, 4> buffer{};
+
+    // Exercise
+    auto lent = at.acquire_read().value();
+    auto lent_text =
+      std::string(reinterpret_cast<const char*>(lent.data()), lent.size());
+    at.release_read(2);
+    auto data = at.server_read(buffer).value().data;
+    auto remaining = at.acquire_read().value();
+
+    // Verify
+    expect("Hello, World"sv == lent_text);
+    expect("llo,"sv ==
+           std::string_view(reinterpret_cast<const char*>(data.data()),
+                            data.size()));
+    expect(" World"sv ==
+           std::string_view(reinterpret_cast<const char*>(remaining.data()),
+                            remaining.size()));
+  };
+
+  "at::link demultiplexes +IPD by link id"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    mock.m_stream_out = stream_out("\r\nOK\r\n"sv);
+    at.set_connection_mode(at::connection_mode::multiple,
+                           hal::never_timeout())
+      .value();
+    mock.m_stream_out =
+      stream_out("+IPD,0,3:abc\r\n+IPD,3,4:wxyz\r\n+IPD,0,2:de"sv);
+    auto link0 = at.get_link(0).value();
+    auto link3 = at.get_link(3).value();
+    std::array<hal::byte, 16> buffer{};
+
+    // Exercise
+    auto data3 = link3.read(buffer).value().data;
+    auto text3 =
+      std::string(reinterpret_cast<const char*>(data3.data()), data3.size());
+    auto data0 = link0.read(buffer).value().data;
+    auto text0 =
+      std::string(reinterpret_cast<const char*>(data0.data()), data0.size());
+
+    // Verify
+    expect("wxyz"sv == text3);
+    expect("abcde"sv == text0);
+    expect(!at.get_link(at::maximum_links));
+  };
+
+  "at::start_server() + ::accept() hand out client links"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    auto single_mode = at.start_server(80, hal::never_timeout());
+    mock.m_stream_out = stream_out("\r\nOK\r\n\r\nOK\r\n\r\nOK\r\n"
+                                   "3,CONNECT\r\n1,CONNECT\r\n3,CLOSED\r\n"
+                                   "+IPD,1,4:ping"sv);
+    mock.m_written.clear();
+    std::array<hal::byte, 8> buffer{};
+
+    // Exercise
+    at.set_connection_mode(at::connection_mode::multiple,
+                           hal::never_timeout())
+      .value();
+    at.start_server(80, hal::never_timeout()).value();
+    at.set_server_timeout(std::chrono::seconds(180), hal::never_timeout())
+      .value();
+    auto client = at.accept().value();
+    auto data = client.read(buffer).value().data;
+    auto nobody = at.accept();
+
+    // Verify
+    expect(!single_mode);
+    expect(1 == client.id());
+    expect("ping"sv ==
+           std::string_view(reinterpret_cast<const char*>(data.data()),
+                            data.size()));
+    expect(!nobody);
+    expect("AT+CIPMUX=1\r\nAT+CIPSERVER=1,80\r\nAT+CIPSTO=180\r\n"sv ==
+           mock.m_written);
+  };
+
+  "at::link::write() addresses its link id"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    mock.m_stream_out = stream_out("\r\nOK\r\n\r\nOK\r\n> \r\nSEND OK\r\n"sv);
+    at.set_connection_mode(at::connection_mode::multiple,
+                           hal::never_timeout())
+      .value();
+    auto link2 = at.get_link(2).value();
+    mock.m_written.clear();
+
+    // Exercise
+    auto result = link2.write(hal::as_bytes("hi"sv), hal::never_timeout());
+
+    // Verify
+    expect(bool(result));
+    expect("AT+CIPSEND=2,2\r\nhi"sv == mock.m_written);
+  };
+
+  "at::link::disconnect() names the link only in multiple mode"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    mock.m_stream_out = stream_out("\r\nOK\r\n\r\nOK\r\n\r\nOK\r\n"sv);
+    mock.m_written.clear();
+
+    // Exercise
+    auto single = at.disconnect_from_server(hal::never_timeout());
+    at.set_connection_mode(at::connection_mode::multiple,
+                           hal::never_timeout())
+      .value();
+    auto multiple = at.get_link(3).value().disconnect(hal::never_timeout());
+
+    // Verify
+    expect(bool(single));
+    expect(bool(multiple));
+    expect("AT+CIPCLOSE\r\nAT+CIPMUX=1\r\nAT+CIPCLOSE=3\r\n"sv ==
+           mock.m_written);
+  };
+
+  "at::server_read() pulls announced data in passive receive mode"_test =
+    []() {
+      using namespace std::literals;
+      // Setup
+      mock_serial mock;
+      mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+      std::array<hal::byte, 2048> receive_buffer{};
+      auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+      mock.m_stream_out = stream_out("\r\nOK\r\n"sv);
+      at.set_receive_mode(at::receive_mode::passive, hal::never_timeout())
+        .value();
+      mock.m_stream_out =
+        stream_out("+IPD,12\r\n+CIPRECVDATA:12,Hello, World\r\nOK\r\n"sv);
+      std::array<hal::byte, 16> buffer{};
+      mock.m_written.clear();
+
+      // Exercise
+      auto data = at.server_read(buffer, hal::never_timeout()).value().data;
+
+      // Verify
+      expect("Hello, World"sv ==
+             std::string_view(reinterpret_cast<const char*>(data.data()),
+                              data.size()));
+      expect("AT+CIPRECVDATA=12\r\n"sv == mock.m_written);
+    };
+
+  "at::start_transparent_mode() + ::stop_transparent_mode()"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    mock.m_stream_out = stream_out("\r\nOK\r\n\r\nOK\r\n\r\n>raw"sv);
+    std::array<hal::byte, 8> buffer{};
+
+    // Exercise
+    auto stream = at.start_transparent_mode(hal::never_timeout()).value();
+    mock.m_written.clear();
+    stream.write(hal::as_bytes("data"sv)).value();
+    auto data = stream.read(buffer).value().data;
+    auto text =
+      std::string(reinterpret_cast<const char*>(data.data()), data.size());
+    mock.m_stream_out = stream_out("\r\nOK\r\n"sv);
+    auto expired = []() -> hal::status {
+      return hal::new_error(std::errc::timed_out);
+    };
+    auto stopped =
+      at.stop_transparent_mode(expired, expired, hal::never_timeout());
+
+    // Verify
+    expect("raw"sv == text);
+    expect(bool(stopped));
+    expect("data+++AT+CIPMODE=0\r\n"sv == mock.m_written);
+  };
+
+  "at::run_commands() matches responses in order"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    // The second command arrives while the first is running
+    mock.m_stream_out =
+      stream_out("busy p...\r\nOK\r\n\r\nERROR\r\n\r\nOK\r\n"sv);
+    mock.m_written.clear();
+    mock.m_write_count = 0;
+    std::array commands{ "AT+CWMODE=1"sv, "AT+CIPMUX=0"sv, "AT+CIPDINFO=1"sv };
+    std::array<at::command_status, commands.size()> status{};
+
+    // Exercise
+    auto result = at.run_commands(commands, status, hal::never_timeout());
+
+    // Verify
+    expect(!result);
+    expect(at::command_status::ok == status[0]);
+    expect(at::command_status::ok == status[1]);
+    expect(at::command_status::error == status[2]);
+    expect("AT+CWMODE=1\r\nAT+CIPMUX=0\r\nAT+CIPDINFO=1\r\nAT+CIPMUX=0\r\n"sv ==
+           mock.m_written);
+    expect(4u == mock.m_write_count);
+  };
+
+  "at::start_connect_to_ap() advances on poll()"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    mock.m_idle_reads = true;
+    mock.m_stream_out = stream_out("\r\nO"sv);
+    mock.m_written.clear();
+
+    // Exercise
+    auto operation = at.start_connect_to_ap("ssid"sv, "pass"sv).value();
+    auto waiting = operation.poll().value();
+    auto busy = at.start_disconnect_from_ap();
+    mock.m_stream_out = stream_out("K\r\n"sv);
+    auto joining = operation.poll().value();
+    auto command = mock.m_written;
+    mock.m_stream_out = stream_out("WIFI CONNECTED\r\n\r\nOK\r\n"sv);
+    auto joined = operation.poll().value();
+
+    // Verify
+    expect(hal::work_state::in_progress == waiting);
+    expect(!busy);
+    expect(hal::work_state::in_progress == joining);
+    expect("AT+CWMODE=1\r\nAT+CWJAP=\"ssid\",\"pass\"\r\n"sv == command);
+    expect(hal::work_state::finished == joined);
+    expect(bool(at.start_disconnect_from_ap()));
+  };
+
+  "at::server_read() leaves a running operation's responses alone"_test =
+    []() {
+      using namespace std::literals;
+      // Setup
+      mock_serial mock;
+      mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+      std::array<hal::byte, 2048> receive_buffer{};
+      auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+      mock.m_idle_reads = true;
+      mock.m_stream_out = stream_out("\r\n>"sv);
+      std::array<hal::byte, 8> buffer{};
+
+      // Exercise
+      auto operation = at.start_server_write(hal::as_bytes("hi"sv)).value();
+      auto prompted = operation.poll().value();
+      mock.m_stream_out = stream_out("\r\nSEND OK\r\n+IPD,4:pong"sv);
+      auto busy = at.server_read(buffer);
+      auto sent = operation.poll().value();
+      auto data = at.server_read(buffer).value().data;
+
+      // Verify
+      expect(hal::work_state::in_progress == prompted);
+      expect(!busy);
+      expect(hal::work_state::finished == sent);
+      expect("pong"sv ==
+             std::string_view(reinterpret_cast<const char*>(data.data()),
+                              data.size()));
+    };
+
+  "at::warm_start() keeps the running session"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out =
+      stream_out("ATE0\r\r\n\r\nOK\r\n"
+                 "+CIPMUX:1\r\n\r\nOK\r\n"
+                 "+CIPRECVMODE:1\r\n\r\nOK\r\n"
+                 "STATUS:3\r\n"
+                 "+CIPSTATUS:1,\"TCP\",\"10.0.0.9\",80,4000,0\r\n"
+                 "+CIPSTATUS:2,\"UDP\",\"10.0.0.9\",5000,6000,0\r\n"
+                 "\r\nOK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    std::array<hal::byte, 8> buffer{};
 
     // Exercise
+    auto at = at::warm_start(mock,
+                             receive_buffer,
+                             hal::never_timeout(),
+                             hal::never_timeout())
+                .value();
+    mock.m_idle_reads = true;
+    auto udp =
+      at.get_link(2).value().receive_from(buffer, hal::never_timeout());
+    auto tcp =
+      at.get_link(1).value().receive_from(buffer, hal::never_timeout());
+
+    // Verify
+    expect("ATE0\r\nAT+CIPMUX?\r\nAT+CIPRECVMODE?\r\nAT+CIPSTATUS\r\n"sv ==
+           mock.m_written);
+    expect(bool(at.get_link(3)));
+    expect(bool(udp));
+    expect(!tcp);
+  };
+
+  "at::warm_start() drops the probe's replies before resetting"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    // The probe is answered, but a stray OK is still waiting when the query
+    // after it fails
+    mock.m_stream_out =
+      stream_out("ATE0\r\r\n\r\nOK\r\nERROR\r\n\r\nOK\r\n"sv);
+    mock.m_flush_streams = { "\r\nOK\r\nready\r\n\r\nOK\r\n"sv };
+    std::array<hal::byte, 2048> receive_buffer{};
+
+    // Exercise
+    auto at = at::warm_start(mock,
+                             receive_buffer,
+                             hal::never_timeout(),
+                             hal::never_timeout())
+                .value();
+
+    // Verify
+    expect("ATE0\r\nAT+CIPMUX?\r\nAT+RST\r\nATE0\r\n"sv == mock.m_written);
+    expect(!at.get_link(3));
+  };
+
+  "at::set_baud_rate()"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    mock.m_stream_out = stream_out("\r\nOK\r\n"sv);
+    mock.m_configure_streams = { "\r\nOK\r\n"sv };
+    mock.m_written.clear();
+    at.set_serial_settings({
+      .stop = hal::serial::settings::stop_bits::two,
+      .parity = hal::serial::settings::parity::even,
+    });
+
+    // Exercise
+    auto result =
+      at.set_baud_rate(921600, hal::never_timeout(), hal::never_timeout());
+
+    // Verify
+    expect(bool(result));
+    expect(921600u == at.baud_rate());
+    expect(921600.0f == mock.m_settings.baud_rate);
+    expect(hal::serial::settings::stop_bits::two == mock.m_settings.stop);
+    expect(hal::serial::settings::parity::even == mock.m_settings.parity);
+    expect("AT+UART_CUR=921600,8,1,0,0\r\nAT\r\n"sv == mock.m_written);
+  };
+
+  "at::reset() returns to the default rate after AT+RST is answered"_test =
+    []() {
+      using namespace std::literals;
+      // Setup
+      mock_serial mock;
+      mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+      std::array<hal::byte, 2048> receive_buffer{};
+      auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+      mock.m_stream_out = stream_out("\r\nOK\r\n"sv);
+      mock.m_configure_streams = { "\r\nOK\r\n"sv };
+      at.set_baud_rate(921600, hal::never_timeout(), hal::never_timeout())
+        .value();
+      // The OK to AT+RST still comes at the fast rate
+      mock.m_stream_out = stream_out("\r\nOK\r\n"sv);
+      mock.m_configure_streams = { "ready\r\n\r\nOK\r\n"sv };
+      mock.m_written.clear();
+
+      // Exercise
+      auto result = at.reset(hal::never_timeout());
+
+      // Verify
+      expect(bool(result));
+      expect(115200u == at.baud_rate());
+      expect(115200.0f == mock.m_settings.baud_rate);
+      expect("AT+RST\r\nATE0\r\n"sv == mock.m_written);
+    };
+
+  "at::set_baud_rate() falls back to the previous rate"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    mock.m_stream_out = stream_out("\r\nOK\r\n"sv);
+    // Nothing intelligible at 2M, the probe at 115200 gets through
+    mock.m_configure_streams = { ""sv, "\r\nOK\r\n"sv };
+
+    // Exercise
+    auto result =
+      at.set_baud_rate(2000000, hal::never_timeout(), hal::never_timeout());
+
+    // Verify
+    expect(!result);
+    expect(115200u == at.baud_rate());
+    expect(115200.0f == mock.m_settings.baud_rate);
+  };
+
+  "at::set_flow_control()"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    mock.m_stream_out = stream_out("\r\nOK\r\n"sv);
+    mock.m_written.clear();
+
+    // Exercise
+    auto result =
+      at.set_flow_control(at::flow_control::rts_cts, hal::never_timeout());
+
+    // Verify
+    expect(bool(result));
+    expect("AT+UART_CUR=115200,8,1,0,3\r\n"sv == mock.m_written);
+  };
+
+  "at::set_lossless() reports malformed +IPD headers"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    std::array<hal::byte, 16> buffer{};
+    at.set_lossless(true);
+    mock.m_stream_out = stream_out("+IPD,1x:a+IPD,2:bc"sv);
+
+    // Exercise
+    auto malformed = at.server_read(buffer);
+    auto next = at.server_read(buffer);
+
+    // Verify
+    expect(!malformed);
+    expect(bool(next));
+    expect("bc"sv == std::string_view(
+                       reinterpret_cast<const char*>(next.value().data.data()),
+                       next.value().data.size()));
+  };
+
+  "at::set_network_config() sends the settings back to back"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    mock.m_stream_out = stream_out("\r\nOK\r\n\r\nOK\r\n\r\nOK\r\n"sv);
+    mock.m_written.clear();
+
+    // Exercise
+    auto applied = at.set_network_config({ .ip = "192.168.1.20",
+                                           .gateway = "192.168.1.1",
+                                           .netmask = "255.255.255.0",
+                                           .primary_dns = "1.1.1.1" },
+                                         hal::never_timeout());
+    auto no_netmask = at.set_network_config(
+      { .ip = "192.168.1.20", .gateway = "192.168.1.1" },
+      hal::never_timeout());
+
+    // Verify
+    expect(bool(applied));
+    expect(!no_netmask);
+    expect("AT+CWDHCP_CUR=1,0\r\n"
+           "AT+CIPSTA_CUR=\"192.168.1.20\",\"192.168.1.1\",\"255.255.255.0\""
+           "\r\nAT+CIPDNS_CUR=1,\"1.1.1.1\"\r\n"sv == mock.m_written);
+  };
+
+  "at::scan() parses each access point"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    mock.m_stream_out =
+      stream_out("\r\nOK\r\n"
+                 "+CWLAP:(\"home\",-42,\"aa:bb:cc:dd:ee:01\",6)\r\n"
+                 "+CWLAP:(\"a\",\"b\",-71,\"aa:bb:cc:dd:ee:02\",11)\r\n"
+                 "+CWLAP:(\"far\",-90,\"aa:bb:cc:dd:ee:03\",1)\r\n"
+                 "\r\nOK\r\n"sv);
+    mock.m_written.clear();
+    std::array<at::scan_result, 2> results{};
+
+    // Exercise
+    auto found = at.scan(results, hal::never_timeout()).value();
+
+    // Verify
+    expect(2 == found.size());
+    expect("home"sv == found[0].name());
+    expect(-42 == found[0].rssi);
+    expect(6 == found[0].channel);
+    expect("aa:bb:cc:dd:ee:01"sv ==
+           std::string_view(found[0].bssid.data(), found[0].bssid.size()));
+    expect("a\",\"b"sv == found[1].name());
+    expect(-71 == found[1].rssi);
+    expect(11 == found[1].channel);
+    expect("AT+CWLAPOPT=1,30\r\nAT+CWLAP\r\n"sv == mock.m_written);
+  };
+
+  "at::is_connected_to_ap()"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    mock.m_stream_out = stream_out(
+      "+CWJAP:\"ssid\",\"aa:bb:cc:dd:ee:ff\",6,-50\r\n\r\nOK\r\n"
+      "No AP\r\n\r\nOK\r\n"sv);
+
+    // Exercise
+    auto connected = at.is_connected_to_ap(hal::never_timeout()).value();
+    auto disconnected = at.is_connected_to_ap(hal::never_timeout()).value();
+
+    // Verify
+    expect(connected);
+    expect(!disconnected);
+  };
+
+  "at::is_connected_to_ap() keeps a full segment for a link"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, at::maximum_links * at::maximum_packet_size>
+      receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    mock.m_stream_out = stream_out("\r\nOK\r\n"sv);
+    at.set_connection_mode(at::connection_mode::multiple,
+                           hal::never_timeout())
+      .value();
+    auto payload = std::string(1460, 'x');
+    auto stream = "+IPD,2,1460:" + payload + "\r\nNo AP\r\n\r\nOK\r\n";
+    mock.m_stream_out = stream_out(std::string_view(stream));
+    auto link2 = at.get_link(2).value();
+    std::array<hal::byte, 2048> buffer{};
+
+    // Exercise
+    auto connected = at.is_connected_to_ap(hal::never_timeout());
+    auto data = link2.read(buffer).value().data;
+
+    // Verify
+    expect(connected && !connected.value());
+    expect(payload ==
+           std::string(reinterpret_cast<const char*>(data.data()),
+                       data.size()));
+  };
+
+  "at::set_link_buffer_sizes() gives one link more of the buffer"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    mock.m_stream_out = stream_out("\r\nOK\r\n"sv);
+    at.set_connection_mode(at::connection_mode::multiple,
+                           hal::never_timeout())
+      .value();
+    auto payload = std::string(1460, 'x');
+    auto stream = "+IPD,0,1460:" + payload + "\r\nNo AP\r\n\r\nOK\r\n";
+    mock.m_stream_out = stream_out(std::string_view(stream));
+    auto link0 = at.get_link(0).value();
+    std::array<hal::byte, 2048> buffer{};
+
+    // Exercise
+    auto too_large = at.set_link_buffer_sizes({ 1460, 0, 0, 0, 589 });
+    auto resized = at.set_link_buffer_sizes({ 1460, 0, 0, 0, 588 });
+    auto connected = at.is_connected_to_ap(hal::never_timeout());
+    auto data = link0.read(buffer).value().data;
+
+    // Verify
+    expect(!too_large);
+    expect(bool(resized));
+    expect(connected && !connected.value());
+    expect(payload ==
+           std::string(reinterpret_cast<const char*>(data.data()),
+                       data.size()));
+  };
+
+  "at::connected_access_point() + ::connect_to_ap() by BSSID"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    mock.m_stream_out = stream_out(
+      "+CWJAP:\"my \"net\", 2\",\"aa:bb:cc:dd:ee:ff\",11,-67\r\n\r\nOK\r\n"
+      "\r\nOK\r\n\r\nOK\r\n"
+      "No AP\r\n\r\nOK\r\n"sv);
+    mock.m_written.clear();
+
+    // Exercise
+    auto joined = at.connected_access_point(hal::never_timeout()).value();
+    auto bssid = std::string_view(joined.bssid.data(), joined.bssid.size());
+    auto rejoined =
+      at.connect_to_ap("ssid", "pass", bssid, hal::never_timeout());
+    auto not_joined = at.connected_access_point(hal::never_timeout());
+
+    // Verify
+    expect("aa:bb:cc:dd:ee:ff"sv == bssid);
+    expect(11u == joined.channel);
+    expect(-67 == joined.rssi);
+    expect(bool(rejoined));
+    expect(!not_joined);
+    expect("AT+CWJAP?\r\n"
+           "AT+CWMODE=1\r\n"
+           "AT+CWJAP=\"ssid\",\"pass\",\"aa:bb:cc:dd:ee:ff\"\r\n"
+           "AT+CWJAP?\r\n"sv == mock.m_written);
+  };
+
+  "at::server_write() keeps a +IPD that arrives before SEND OK"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    mock.m_stream_out = stream_out(
+      "\r\nOK\r\n> \r\nRecv 5 bytes\r\n+IPD,4:pong\r\nSEND OK\r\n"sv);
+    std::array<hal::byte, 16> buffer{};
+
+    // Exercise
+    auto write_result =
+      at.server_write(hal::as_bytes("ping\n"sv), hal::never_timeout());
+    auto data = at.server_read(buffer).value().data;
+
+    // Verify
+    expect(bool(write_result));
+    expect("pong"sv ==
+           std::string_view(reinterpret_cast<const char*>(data.data()),
+                            data.size()));
+  };
+
+  "at::server_write() segments large writes"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    mock.m_stream_out =
+      stream_out("\r\n>\r\nSEND OK\r\n\r\n>\r\nSEND OK\r\n"sv);
+    mock.m_written.clear();
+    std::array<hal::byte, 2051> data{};
+    data.fill('x');
+
+    // Exercise
+    auto result = at.server_write(data, hal::never_timeout());
+
+    // Verify
+    expect(bool(result));
+    expect(data.size() == result.value().data.size());
+    expect("AT+CIPSEND=2048\r\n"sv ==
+           std::string_view(mock.m_written).substr(0, 17));
+    expect("AT+CIPSEND=3\r\nxxx"sv ==
+           std::string_view(mock.m_written).substr(17 + 2048));
+  };
+
+  "at::server_write_buffered() keeps segments in flight"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    at.set_send_window(2);
+    mock.m_stream_out = stream_out("1,0\r\n\r\nOK\r\n> Recv 2 bytes\r\n"
+                                   "2,0\r\n\r\nOK\r\n> Recv 2 bytes\r\n"
+                                   "1,SEND OK\r\n"
+                                   "3,1\r\n\r\nOK\r\n> Recv 2 bytes\r\n"
+                                   "2,SEND OK\r\n3,SEND OK\r\n"sv);
+    mock.m_written.clear();
+
+    // Exercise
+    auto first = at.server_write_buffered(hal::as_bytes("ab"sv),
+                                          hal::never_timeout());
+    auto second = at.server_write_buffered(hal::as_bytes("cd"sv),
+                                           hal::never_timeout());
+    auto in_flight = at.acknowledged_segments();
+    // The window is full, so this waits for segment 1
+    auto third = at.server_write_buffered(hal::as_bytes("ef"sv),
+                                          hal::never_timeout());
+    auto done = at.wait_for_segments(third.value(), hal::never_timeout());
+
+    // Verify
+    expect(1u == first.value());
+    expect(2u == second.value());
+    expect(0u == in_flight);
+    expect(bool(done));
+    expect(3u == at.acknowledged_segments());
+    expect(0u == at.failed_segments());
+    expect("AT+CIPSENDBUF=2\r\nab"
+           "AT+CIPSENDBUF=2\r\ncd"
+           "AT+CIPSENDBUF=2\r\nef"sv == mock.m_written);
+  };
+
+  "at::send_to() + ::receive_from() keep datagrams whole"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    // A datagram arrives while the send is being answered
+    mock.m_stream_out = stream_out("\r\nOK\r\nCONNECT\r\n\r\nOK\r\n\r\n> "
+                                   "+IPD,2,10.0.0.9,5000:hi\r\nSEND OK\r\n"
+                                   "+IPD,3,10.0.0.7,6000:abc"sv);
+    mock.m_written.clear();
+    std::array<hal::byte, 8> buffer{};
+    std::array<hal::byte, 8> second_buffer{};
+
+    // Exercise
+    at.set_remote_info(true, hal::never_timeout()).value();
+    at.connect_to_server({ .type = at::socket_type::udp,
+                           .domain = "10.0.0.9",
+                           .port = 5000,
+                           .local_port = 4000 },
+                         hal::never_timeout())
+      .value();
+    auto sent = at.send_to(
+      hal::as_bytes("hey"sv), "10.0.0.9", 5000, hal::never_timeout());
+    auto parked = at.receive_from(buffer, hal::never_timeout()).value();
+    auto direct = at.receive_from(second_buffer, hal::never_timeout()).value();
+    auto none = at.receive_from(buffer, hal::never_timeout()).value();
+
+    // Verify
+    expect(bool(sent));
+    expect("hi"sv ==
+           std::string_view(reinterpret_cast<const char*>(parked.data.data()),
+                            parked.data.size()));
+    expect("10.0.0.9"sv == parked.remote_address());
+    expect(5000 == parked.port);
+    expect("abc"sv ==
+           std::string_view(reinterpret_cast<const char*>(direct.data.data()),
+                            direct.data.size()));
+    expect("10.0.0.7"sv == direct.remote_address());
+    expect(6000 == direct.port);
+    expect(none.data.empty());
+    expect("AT+CIPDINFO=1\r\n"
+           "AT+CIPSTART=\"UDP\",\"10.0.0.9\",5000,4000,2\r\n"
+           "AT+CIPSEND=3,\"10.0.0.9\",5000\r\nhey"sv == mock.m_written);
+  };
+
+  // AT+CIPSSLSIZE only exists in the 1.7.x firmware
+  "at::start_connect_to_server() times an SSL handshake"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock_steady_clock clock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    mock.m_stream_out = stream_out("\r\nOK\r\n"sv);
+    mock.m_written.clear();
+    at.measure_connect_time(clock);
+
+    // Exercise
+    at.set_ssl_buffer_size(4096, hal::never_timeout()).value();
+    auto too_small = at.set_ssl_buffer_size(1024, hal::never_timeout());
+    mock.m_idle_reads = true;
+    mock.m_stream_out = stream_out(""sv);
+    clock.m_ticks = 1'000;
+    auto operation = at.start_connect_to_server({ .type = at::socket_type::ssl,
+                                                  .domain = "example.com",
+                                                  .port = 443,
+                                                  .keep_alive = 60 })
+                       .value();
+    auto handshaking = operation.poll().value();
+    clock.m_ticks = 251'000;
+    mock.m_stream_out = stream_out("CONNECT\r\n\r\nOK\r\n"sv);
+    auto connected = operation.poll().value();
+
+    // Verify
+    expect(!too_small);
+    expect(hal::work_state::in_progress == handshaking);
+    expect(hal::work_state::finished == connected);
+    expect(std::chrono::milliseconds(250) == at.last_connect_time());
+    expect("AT+CIPSSLSIZE=4096\r\n"
+           "AT+CIPSTART=\"SSL\",\"example.com\",443,60\r\n"sv ==
+           mock.m_written);
+  };
+
+  // AT+CIPSSLCCONF only exists in the 2.x firmware
+  "at::set_ssl_auth() names the link only in multiple mode"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    mock.m_stream_out = stream_out("\r\nOK\r\n\r\nOK\r\n\r\nOK\r\n"sv);
+    mock.m_written.clear();
+
+    // Exercise
+    auto single = at.set_ssl_auth(at::ssl_auth::server_certificate,
+                                  hal::never_timeout());
+    at.set_connection_mode(at::connection_mode::multiple,
+                           hal::never_timeout())
+      .value();
+    auto link2 = at.get_link(2).value();
+    auto multiple =
+      link2.set_ssl_auth(at::ssl_auth::mutual, hal::never_timeout());
+
+    // Verify
+    expect(bool(single));
+    expect(bool(multiple));
+    expect("AT+CIPSSLCCONF=2\r\nAT+CIPMUX=1\r\nAT+CIPSSLCCONF=2,3\r\n"sv ==
+           mock.m_written);
+  };
+
+  "at::server_read() finishes a partial datagram on the next call"_test =
+    []() {
+      using namespace std::literals;
+      // Setup
+      mock_serial mock;
+      mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+      std::array<hal::byte, 2048> receive_buffer{};
+      auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+      mock.m_stream_out = stream_out("CONNECT\r\n\r\nOK\r\n"sv);
+      at.connect_to_server(
+          { .type = at::socket_type::udp, .domain = "10.0.0.9", .port = 5000 },
+          hal::never_timeout())
+        .value();
+      mock.m_idle_reads = true;
+      mock.m_stream_out = stream_out("+IPD,4,10.0.0.9,5000:ab"sv);
+      std::array<hal::byte, 8> buffer{};
+
+      // Exercise
+      auto partial = at.server_read(buffer).value().data;
+      mock.m_stream_out = stream_out("cd"sv);
+      auto whole = at.server_read(buffer).value().data;
+
+      // Verify
+      expect(partial.empty());
+      expect("abcd"sv ==
+             std::string_view(reinterpret_cast<const char*>(whole.data()),
+                              whole.size()));
+    };
+
+  "at::receive_from() reports a datagram too large for the buffer"_test =
+    []() {
+      using namespace std::literals;
+      // Setup
+      mock_serial mock;
+      mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+      std::array<hal::byte, 16> receive_buffer{};
+      auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+      // Both datagrams arrive while the send is being answered
+      mock.m_stream_out = stream_out("CONNECT\r\n\r\nOK\r\n\r\n> "
+                                     "+IPD,12:0123456789ab\r\n"
+                                     "+IPD,2:hi\r\nSEND OK\r\n"sv);
+      std::array<hal::byte, 16> buffer{};
+
+      // Exercise
+      at.connect_to_server(
+          { .type = at::socket_type::udp, .domain = "10.0.0.9", .port = 5000 },
+          hal::never_timeout())
+        .value();
+      auto sent = at.send_to(
+        hal::as_bytes("hey"sv), "10.0.0.9", 5000, hal::never_timeout());
+      auto too_large = at.receive_from(buffer, hal::never_timeout());
+      auto next = at.receive_from(buffer, hal::never_timeout()).value();
+
+      // Verify
+      expect(bool(sent));
+      expect(!too_large);
+      expect("hi"sv ==
+             std::string_view(reinterpret_cast<const char*>(next.data.data()),
+                              next.data.size()));
+    };
+
+  "at::link::connect() forgets UDP when the connect fails"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    mock.m_stream_out = stream_out("\r\nOK\r\n\r\nERROR\r\n"sv);
+    at.set_connection_mode(at::connection_mode::multiple,
+                           hal::never_timeout())
+      .value();
+    auto link2 = at.get_link(2).value();
+    std::array<hal::byte, 8> buffer{};
+
+    // Exercise
+    auto connected = link2.connect(
+      { .type = at::socket_type::udp, .domain = "10.0.0.9", .port = 5000 },
+      hal::never_timeout());
+    auto received = link2.receive_from(buffer, hal::never_timeout());
+
+    // Verify
+    expect(!connected);
+    expect(!received);
+  };
+
+  "at::connect_to_server() sends the command in one write"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    mock.m_stream_out = stream_out("CONNECT\r\n\r\nOK\r\n"sv);
+    mock.m_written.clear();
+    mock.m_write_count = 0;
+    std::string long_domain(100, 'a');
+
+    // Exercise
+    auto result = at.connect_to_server(
+      { .domain = "example.com", .port = 8080 }, hal::never_timeout());
+    auto too_long =
+      at.connect_to_server({ .domain = long_domain }, hal::never_timeout());
+
+    // Verify
+    expect(bool(result));
+    expect(!too_long);
+    expect(1u == mock.m_write_count);
+    expect("AT+CIPSTART=\"TCP\",\"example.com\",8080\r\n"sv ==
+           mock.m_written);
+  };
+
+  "at::enable_dns_cache() reconnects by address"_test = []() {
+    using namespace std::literals;
+    using namespace std::chrono_literals;
+    // Setup
+    mock_serial mock;
+    mock_steady_clock clock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    at.enable_dns_cache(clock, 10s);
+    mock.m_stream_out = stream_out(
+      "+CIPDOMAIN:93.184.216.34\r\n\r\nOK\r\nCONNECT\r\n\r\nOK\r\n"
+      "CONNECT\r\n\r\nOK\r\n"
+      "+CIPDOMAIN:\"93.184.216.35\"\r\n\r\nOK\r\nCONNECT\r\n\r\nOK\r\n"sv);
+    mock.m_written.clear();
+
+    // Exercise
+    auto first = at.connect_to_server({ .domain = "example.com" },
+                                      hal::never_timeout());
+    clock.m_ticks = 9'000'000;
+    auto second = at.connect_to_server({ .domain = "example.com" },
+                                       hal::never_timeout());
+    clock.m_ticks = 11'000'000;
+    auto expired = at.connect_to_server({ .domain = "example.com" },
+                                        hal::never_timeout());
+
+    // Verify
+    expect(bool(first));
+    expect(bool(second));
+    expect(bool(expired));
+    expect("AT+CIPDOMAIN=\"example.com\"\r\n"
+           "AT+CIPSTART=\"TCP\",\"93.184.216.34\",80\r\n"
+           "AT+CIPSTART=\"TCP\",\"93.184.216.34\",80\r\n"
+           "AT+CIPDOMAIN=\"example.com\"\r\n"
+           "AT+CIPSTART=\"TCP\",\"93.184.216.35\",80\r\n"sv ==
+           mock.m_written);
+  };
+
+  "at::connect_to_server() reports ERROR responses"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    mock.m_stream_out = stream_out("DNS Fail\r\nERROR\r\n"sv);
+
+    // Exercise
+    auto result = at.connect_to_server({ .domain = "example.com" },
+                                       hal::never_timeout());
+
+    // Verify
+    expect(!result);
+  };
+
+  "at::on_event() reports notifications inside a response"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    std::vector<at::event> events;
+    at.on_event([&events](at::event p_event, std::uint8_t) {
+      events.push_back(p_event);
+    });
+    mock.m_stream_out = stream_out(
+      "+IPD,2:hi\r\nWIFI DISCONNECT\r\nNo AP\r\n\r\nOK\r\n"sv);
+    std::array<hal::byte, 8> buffer{};
+
+    // Exercise
+    auto connected = at.is_connected_to_ap(hal::never_timeout()).value();
+    auto data = at.server_read(buffer).value().data;
+
+    // Verify
+    expect(!connected);
+    expect(1u == events.size());
+    expect(at::event::ap_disconnected == events.at(0));
+    expect("hi"sv ==
+           std::string_view(reinterpret_cast<const char*>(data.data()),
+                            data.size()));
+  };
+
+  "at::poll_events() reports the link of a notification"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    mock.m_stream_out = stream_out("\r\nOK\r\n"sv);
+    at.set_connection_mode(at::connection_mode::multiple,
+                           hal::never_timeout())
+      .value();
+    std::vector<std::pair<at::event, std::uint8_t>> events;
+    at.on_event([&events](at::event p_event, std::uint8_t p_link) {
+      events.emplace_back(p_event, p_link);
+    });
+    mock.m_idle_reads = true;
+    mock.m_stream_out =
+      stream_out("1,CONNECT\r\n+IPD,1,2:ok\r\n3,CLOSED\r\n"sv);
+    auto link1 = at.get_link(1).value();
+    std::array<hal::byte, 8> buffer{};
+
+    // Exercise
+    auto polled = at.poll_events();
+    auto data = link1.read(buffer).value().data;
+
     // Verify
-    [[maybe_unused]] auto at = at::create(mock, hal::never_timeout()).value();
+    expect(bool(polled));
+    expect(2u == events.size());
+    expect(at::event::link_connected == events.at(0).first);
+    expect(1u == events.at(0).second);
+    expect(at::event::link_closed == events.at(1).first);
+    expect(3u == events.at(1).second);
+    expect("ok"sv ==
+           std::string_view(reinterpret_cast<const char*>(data.data()),
+                            data.size()));
   };
 }
 }  // namespace hal::esp8266
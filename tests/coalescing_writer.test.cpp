@@ -0,0 +1,71 @@
+#include <libhal-esp8266/coalescing_writer.hpp>
+
+#include <array>
+#include <chrono>
+#include <string_view>
+
+#include "helpers.hpp"
+
+#include <boost/ut.hpp>
+
+namespace hal::esp8266 {
+void coalescing_writer_test()
+{
+  using namespace boost::ut;
+  using namespace std::chrono_literals;
+
+  "coalescing_writer sends once the threshold is reached"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock_steady_clock clock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    auto writer =
+      coalescing_writer::create(at.get_link(0).value(), clock, 8, 10ms)
+        .value();
+    mock.m_stream_out = stream_out("\r\n>\r\nSEND OK\r\n"sv);
+    mock.m_written.clear();
+
+    // Exercise
+    writer.write(hal::as_bytes("abc"sv), hal::never_timeout()).value();
+    writer.write(hal::as_bytes("def"sv), hal::never_timeout()).value();
+    auto buffered = mock.m_written;
+    writer.write(hal::as_bytes("gh"sv), hal::never_timeout()).value();
+
+    // Verify
+    expect(""sv == buffered);
+    expect("AT+CIPSEND=8\r\nabcdefgh"sv == mock.m_written);
+    expect(0u == writer.size());
+    expect(!coalescing_writer::create(at.get_link(0).value(), clock, 0, 10ms));
+  };
+
+  "coalescing_writer::poll() sends after the maximum latency"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock_steady_clock clock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    auto writer =
+      coalescing_writer::create(at.get_link(0).value(), clock, 512, 10ms)
+        .value();
+    mock.m_stream_out = stream_out("\r\n>\r\nSEND OK\r\n"sv);
+    mock.m_written.clear();
+
+    // Exercise
+    writer.write(hal::as_bytes("record"sv), hal::never_timeout()).value();
+    clock.m_ticks = 9'999;
+    writer.poll(hal::never_timeout()).value();
+    auto early = mock.m_written;
+    clock.m_ticks = 10'000;
+    writer.poll(hal::never_timeout()).value();
+
+    // Verify
+    expect(""sv == early);
+    expect("AT+CIPSEND=6\r\nrecord"sv == mock.m_written);
+  };
+}
+}  // namespace hal::esp8266
@@ -0,0 +1,160 @@
+#include <libhal-esp8266/coroutine.hpp>
+
+#include <array>
+#include <string_view>
+
+#include "helpers.hpp"
+
+#include <boost/ut.hpp>
+
+namespace hal::esp8266 {
+namespace {
+task join(at& p_esp8266, at::deadline p_timeout)
+{
+  co_return co_await async_connect_to_ap(p_esp8266, "ssid", "pass", p_timeout);
+}
+
+task upload(at& p_esp8266,
+            std::span<const hal::byte> p_data,
+            at::deadline p_timeout)
+{
+  co_return co_await async_server_write(p_esp8266, p_data, p_timeout);
+}
+
+task download(at& p_esp8266,
+              std::span<hal::byte> p_buffer,
+              at::deadline p_timeout)
+{
+  auto read = co_await async_server_read(p_esp8266, p_buffer, p_timeout);
+  if (!read) {
+    co_return read.error();
+  }
+  co_return hal::success();
+}
+}  // namespace
+
+void coroutine_test()
+{
+  using namespace boost::ut;
+
+  "task interleaves operations on one driver"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    mock.m_idle_reads = true;
+    mock.m_stream_out = stream_out(""sv);
+    mock.m_written.clear();
+    auto timeout = hal::never_timeout();
+    auto join_task = join(at, timeout);
+    auto upload_task = upload(at, hal::as_bytes("hi"sv), timeout);
+
+    // Exercise
+    // Run both tasks up to their first co_await, then let the join take the
+    // driver while the upload waits for it.
+    join_task.resume();
+    upload_task.resume();
+    join_task.resume();
+    auto upload_waiting = upload_task.resume();
+    mock.m_stream_out = stream_out("\r\nOK\r\n"sv);
+    join_task.resume();
+    mock.m_stream_out = stream_out("\r\nOK\r\n"sv);
+    auto joined = join_task.resume();
+    mock.m_stream_out = stream_out("\r\n>"sv);
+    upload_task.resume();
+    mock.m_stream_out = stream_out("\r\nSEND OK\r\n"sv);
+    auto uploaded = upload_task.resume();
+
+    // Verify
+    expect(hal::work_state::in_progress == upload_waiting);
+    expect(hal::work_state::finished == joined);
+    expect(hal::work_state::finished == uploaded);
+    expect("AT+CWMODE=1\r\nAT+CWJAP=\"ssid\",\"pass\"\r\n"
+           "AT+CIPSEND=2\r\nhi"sv == mock.m_written);
+  };
+
+  "async_server_read() waits for payload"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    mock.m_idle_reads = true;
+    mock.m_stream_out = stream_out(""sv);
+    std::array<hal::byte, 8> buffer{};
+    auto timeout = hal::never_timeout();
+    auto download_task = download(at, buffer, timeout);
+
+    // Exercise
+    download_task.resume();
+    auto waiting = download_task.resume();
+    mock.m_stream_out = stream_out("+IPD,4:data"sv);
+    auto received = download_task.resume();
+
+    // Verify
+    expect(hal::work_state::in_progress == waiting);
+    expect(hal::work_state::finished == received);
+    expect("data"sv == std::string_view(
+                         reinterpret_cast<const char*>(buffer.data()), 4));
+  };
+
+  "async_server_read() fails once the timeout expires"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    mock.m_idle_reads = true;
+    mock.m_stream_out = stream_out(""sv);
+    std::array<hal::byte, 8> buffer{};
+    int polls_left = 2;
+    auto timeout = [&polls_left]() -> hal::status {
+      if (polls_left-- == 0) {
+        return hal::new_error(std::errc::timed_out);
+      }
+      return hal::success();
+    };
+    auto download_task = download(at, buffer, timeout);
+
+    // Exercise
+    download_task.resume();
+    auto first = download_task.resume();
+    auto second = download_task.resume();
+    auto expired = download_task.resume();
+
+    // Verify
+    expect(hal::work_state::in_progress == first);
+    expect(hal::work_state::in_progress == second);
+    expect(hal::work_state::failed == expired);
+  };
+
+  "destroying a task cancels its operation"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    mock.m_idle_reads = true;
+    mock.m_stream_out = stream_out(""sv);
+    auto timeout = hal::never_timeout();
+    bool busy_while_joining = false;
+
+    // Exercise
+    {
+      auto join_task = join(at, timeout);
+      join_task.resume();
+      join_task.resume();
+      busy_while_joining = at.is_busy();
+    }
+
+    // Verify
+    expect(busy_while_joining);
+    expect(!at.is_busy());
+  };
+}
+}  // namespace hal::esp8266
@@ -16,12 +16,15 @@
 
 #include <algorithm>
 #include <cstdint>
+#include <string>
 #include <string_view>
+#include <vector>
 
 #include <libhal-util/as_bytes.hpp>
 #include <libhal-util/serial.hpp>
 #include <libhal-util/streams.hpp>
 #include <libhal/serial.hpp>
+#include <libhal/steady_clock.hpp>
 
 namespace hal::esp8266 {
 
@@ -61,16 +64,23 @@ private:
 
 struct mock_serial : public hal::serial
 {
-  hal::status driver_configure(
-    [[maybe_unused]] const settings& p_settings) override
+  hal::status driver_configure(const settings& p_settings) override
   {
+    m_settings = p_settings;
+    // Stage what the device says once the host is listening at the new rate
+    if (!m_configure_streams.empty()) {
+      m_stream_out = stream_out(m_configure_streams.front());
+      m_configure_streams.erase(m_configure_streams.begin());
+    }
     return hal::success();
   }
 
   result<write_t> driver_write(std::span<const hal::byte> p_data) override
   {
+    m_write_count++;
     for (const auto& byte : p_data) {
       putchar(static_cast<char>(byte));
+      m_written.push_back(static_cast<char>(byte));
     }
 
     return write_t{ .data = p_data };
@@ -80,7 +90,7 @@ struct mock_serial : public hal::serial
     [[maybe_unused]] std::span<hal::byte> p_data) override
   {
     auto result = m_stream_out(p_data);
-    if (result.data.size() == 0) {
+    if (result.data.size() == 0 && !m_idle_reads) {
       return hal::new_error();
     }
     return result;
@@ -88,11 +98,40 @@ struct mock_serial : public hal::serial
 
   result<flush_t> driver_flush() override
   {
+    // Stage what the device says once the host has dropped what it had
+    if (!m_flush_streams.empty()) {
+      m_stream_out = stream_out(m_flush_streams.front());
+      m_flush_streams.erase(m_flush_streams.begin());
+    }
     return flush_t{};
   }
 
   size_t rotation = 0;
   stream_out m_stream_out;
+  std::string m_written;
+  size_t m_write_count = 0;
+  settings m_settings{};
+  /// Report an exhausted stream as an empty read, like an idle UART, rather
+  /// than as an error
+  bool m_idle_reads = false;
+  std::vector<std::string_view> m_configure_streams;
+  std::vector<std::string_view> m_flush_streams;
+};
+
+struct mock_steady_clock : public hal::steady_clock
+{
+  frequency_t driver_frequency() override
+  {
+    // One tick per microsecond
+    return frequency_t{ .operating_frequency = 1'000'000.0f };
+  }
+
+  uptime_t driver_uptime() override
+  {
+    return uptime_t{ .ticks = m_ticks };
+  }
+
+  std::uint64_t m_ticks = 0;
 };
 
 }  // namespace hal::esp8266
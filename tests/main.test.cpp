@@ -14,9 +14,15 @@
 
 namespace hal::esp8266 {
 extern void at_test();
+extern void coroutine_test();
+extern void coalescing_writer_test();
+extern void supervisor_test();
 }  // namespace hal::esp8266
 
 int main()
 {
   hal::esp8266::at_test();
+  hal::esp8266::coroutine_test();
+  hal::esp8266::coalescing_writer_test();
+  hal::esp8266::supervisor_test();
 }
\ No newline at end of file
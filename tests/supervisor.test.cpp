@@ -0,0 +1,107 @@
+#include <libhal-esp8266/supervisor.hpp>
+
+#include <array>
+#include <chrono>
+#include <string_view>
+
+#include "helpers.hpp"
+
+#include <boost/ut.hpp>
+
+namespace hal::esp8266 {
+void supervisor_test()
+{
+  using namespace boost::ut;
+  using namespace std::chrono_literals;
+
+  "supervisor only runs the steps that are needed"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock_steady_clock clock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    auto supervisor =
+      supervisor::create(at,
+                         clock,
+                         { .ssid = "ssid",
+                           .password = "pass",
+                           .server = { .domain = "example.com" } })
+        .value();
+    mock.m_stream_out = stream_out("No AP\r\n\r\nOK\r\n"
+                                   "\r\nOK\r\n"
+                                   "WIFI CONNECTED\r\nWIFI GOT IP\r\n\r\nOK\r\n"
+                                   "+CWJAP:\"ssid\",\"aa:bb:cc:dd:ee:ff\",6,-50"
+                                   "\r\n\r\nOK\r\n"
+                                   "CONNECT\r\n\r\nOK\r\n"sv);
+    mock.m_written.clear();
+
+    // Exercise
+    auto first = supervisor.poll(hal::never_timeout());
+    auto second = supervisor.poll(hal::never_timeout());
+
+    // Verify
+    expect(hal::work_state::finished == first);
+    expect(hal::work_state::finished == second);
+    expect(supervisor.is_connected());
+    expect("AT+CWJAP?\r\n"
+           "AT+CWMODE=1\r\n"
+           "AT+CWJAP=\"ssid\",\"pass\"\r\n"
+           "AT+CWJAP?\r\n"
+           "AT+CIPSTART=\"TCP\",\"example.com\",80\r\n"sv == mock.m_written);
+  };
+
+  "supervisor backs off after a failed reconnect"_test = []() {
+    using namespace std::literals;
+    // Setup
+    mock_serial mock;
+    mock_steady_clock clock;
+    mock.m_stream_out = stream_out("\r\nOK\r\nready\r\n OK\r\n"sv);
+    std::array<hal::byte, 2048> receive_buffer{};
+    auto at = at::create(mock, receive_buffer, hal::never_timeout()).value();
+    auto supervisor =
+      supervisor::create(at,
+                         clock,
+                         { .ssid = "ssid",
+                           .password = "pass",
+                           .server = { .domain = "example.com" },
+                           .min_backoff = 1s })
+        .value();
+    at.on_event([&supervisor](at::event p_event, std::uint8_t p_link) {
+      supervisor.handle_event(p_event, p_link);
+    });
+    mock.m_stream_out = stream_out("+CWJAP:\"ssid\"\r\n\r\nOK\r\n"
+                                   "+CIPSTATUS:0,\"TCP\"\r\n\r\nOK\r\n"sv);
+    (void)supervisor.poll(hal::never_timeout());
+    mock.m_idle_reads = true;
+    mock.m_stream_out = stream_out("CLOSED\r\n"sv);
+    at.poll_events().value();
+    mock.m_idle_reads = false;
+    mock.m_stream_out = stream_out("ERROR\r\n"
+                                   "+CWJAP:\"ssid\"\r\n\r\nOK\r\n"
+                                   "CONNECT\r\n\r\nOK\r\n"sv);
+    mock.m_written.clear();
+
+    // Exercise
+    auto failed = supervisor.poll(hal::never_timeout());
+    auto failures = supervisor.failures();
+    clock.m_ticks = 500'000;
+    auto waiting = supervisor.poll(hal::never_timeout());
+    auto written_while_waiting = mock.m_written.size();
+    clock.m_ticks = 1'000'000;
+    auto reconnected = supervisor.poll(hal::never_timeout());
+
+    // Verify
+    expect(hal::work_state::in_progress == failed);
+    expect(1u == failures);
+    expect(hal::work_state::in_progress == waiting);
+    expect(36u == written_while_waiting);
+    expect(hal::work_state::finished == reconnected);
+    expect(0u == supervisor.failures());
+    expect("AT+CIPSTART=\"TCP\",\"example.com\",80\r\n"
+           "AT+CWJAP?\r\n"
+           "AT+CIPSTART=\"TCP\",\"example.com\",80\r\n"sv == mock.m_written);
+  };
+}
+}  // namespace hal::esp8266